@@ -0,0 +1,262 @@
+#include "block.h"
+#include "decoder.h"
+#include <stdlib.h>
+
+block_cache *block_cache_new() {
+    block_cache *self = malloc(sizeof(block_cache));
+    if (self == NULL)
+        PANIC("allocating block cache failed");
+#ifdef JIT
+    self->jit = jit_arena_new();
+#endif
+    block_cache_flush(self);
+    return self;
+}
+
+void block_cache_flush(block_cache *self) {
+    uint16_t i;
+    for (i = 0; i < BLOCK_CACHE_SIZE; i++)
+        self->blocks[i].code = NULL;
+#ifdef JIT
+    jit_arena_reset(&self->jit);
+#endif
+}
+
+#ifdef JIT
+void block_translate(block_cache *self, block_t *b, bus *bus) {
+    uint16_t i;
+    /* Once the arena is full every translation is dropped, hot blocks get translated again */
+    if (self->jit.used + JIT_BLOCK_MAX_SIZE > JIT_ARENA_SIZE) {
+        for (i = 0; i < BLOCK_CACHE_SIZE; i++) {
+            self->blocks[i].native = NULL;
+            self->blocks[i].runs = 0;
+        }
+        jit_arena_reset(&self->jit);
+    }
+    b->native = jit_compile(&self->jit, b, bus);
+}
+#endif
+
+/* Control flow and anything that changes whether interrupts are taken ends a block */
+bool block_ends_after(uint16_t op) {
+    if (op >= 0x100)
+        return false;
+    switch (OP_TABLE[op].instruction_type) {
+    case call_instruction:
+    case di_instruction:
+    case ei_instruction:
+    case halt_instruction:
+    case illegal_instruction:
+    case jp_instruction:
+    case jr_instruction:
+    case ret_instruction:
+    case reti_instruction:
+    case rst_instruction:
+    case stop_instruction:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Registers as bits of their REG_x index, with the C flag apart from the rest of F */
+#define IDLE_FLAGS_ZNH (1 << REG_F)
+#define IDLE_FLAG_C (1 << 8)
+#define IDLE_FLAGS (IDLE_FLAGS_ZNH | IDLE_FLAG_C)
+
+bool block_is_reg8(const argument_t *arg) {
+    return arg->e == register_e && arg->p.register_p <= l_register_p;
+}
+
+/*
+ * Registers read and written by an op that may be part of an idle loop, false for anything else.
+ * Only loads into registers, ALU ops on registers and immediates and BIT qualify.
+ */
+bool block_op_effects(const block_op_t *entry, uint16_t *reads, uint16_t *writes) {
+    const op_t *op = &CPU_OPS[entry->op];
+    const instruction_t *instr;
+
+    *reads = 0;
+    *writes = 0;
+    if (entry->op >= 0x100) {
+        instr = &CB_TABLE[entry->op & 0xFF];
+        if (instr->instruction_type != bit_instruction || instr->rhs.e != register_e)
+            return false;
+        *reads = 1 << op->rhs;
+        *writes = IDLE_FLAGS_ZNH;
+        return true;
+    }
+    instr = &OP_TABLE[entry->op];
+    switch (instr->instruction_type) {
+    case noop_instruction:
+        return true;
+    case ld_instruction:
+        if (!block_is_reg8(&instr->lhs))
+            return false;
+        *writes = 1 << op->lhs;
+        switch (instr->rhs.e) {
+        case register_e:
+            *reads = 1 << op->rhs;
+            return true;
+        case imm_u8_e:
+            return true;
+        case io_offset_u8_e:
+            return bus_read_is_stable(IO_START + (entry->imm & 0xFF));
+        case imm_u16_ptr_e:
+            return bus_read_is_stable(entry->imm);
+        default:
+            return false;
+        }
+    case adc_instruction:
+    case add_instruction:
+    case and_instruction:
+    case cp_instruction:
+    case or_instruction:
+    case sbc_instruction:
+    case sub_instruction:
+    case xor_instruction:
+        if (!block_is_reg8(&instr->lhs))
+            return false;
+        if (instr->rhs.e == register_e)
+            *reads = 1 << op->rhs;
+        else if (instr->rhs.e != imm_u8_e)
+            return false;
+        *reads |= 1 << REG_A;
+        if (instr->instruction_type == adc_instruction ||
+            instr->instruction_type == sbc_instruction)
+            *reads |= IDLE_FLAG_C;
+        *writes = IDLE_FLAGS;
+        if (instr->instruction_type != cp_instruction)
+            *writes |= 1 << REG_A;
+        return true;
+    case inc_instruction:
+    case dec_instruction:
+        if (!block_is_reg8(&instr->lhs))
+            return false;
+        *reads = 1 << op->lhs;
+        *writes = (1 << op->lhs) | IDLE_FLAGS_ZNH;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Whether b is an idle loop, see block_t */
+bool block_is_idle(const block_t *b) {
+    const block_op_t *last = &b->ops[b->count - 1];
+    const op_t *branch = &CPU_OPS[last->op];
+    uint16_t written = 0;
+    uint16_t carried = 0;
+    uint16_t target;
+    uint8_t i;
+
+    if (branch->fn == jr)
+        target = b->pc + last->end + (int8_t)last->imm;
+    else if (branch->fn == jp)
+        target = last->imm;
+    else
+        return false;
+    if (target != b->pc)
+        return false;
+    if (branch->lhs == FLAG_Z)
+        carried = IDLE_FLAGS_ZNH;
+    else if (branch->lhs == FLAG_C)
+        carried = IDLE_FLAG_C;
+
+    for (i = b->count - 1; i-- > 0;) {
+        uint16_t reads;
+        uint16_t writes;
+        if (!block_op_effects(&b->ops[i], &reads, &writes))
+            return false;
+        carried = (carried & ~writes) | reads;
+        written |= writes;
+    }
+    /* A register read before it is set would carry a value from one iteration to the next */
+    return (carried & written) == 0;
+}
+
+/* Decodes the instructions at pc up to the end of the block, false if none fits in the page */
+bool block_build(block_t *b, bus *bus, uint16_t pc) {
+    uint8_t page = pc >> PAGE_SHIFT;
+    const uint8_t *code = bus->read_map[page];
+    uint16_t off = pc & (PAGE_SIZE - 1);
+    uint16_t end = off;
+    uint16_t clocks = 0;
+
+    b->count = 0;
+    while (b->count < BLOCK_MAX_OPS) {
+        block_op_t *entry = &b->ops[b->count];
+        uint16_t op = code[end];
+        uint8_t length;
+
+        if (op == 0xCB) {
+            if (end + 1 >= PAGE_SIZE)
+                break;
+            op = 0x100 | code[end + 1];
+        }
+        length = CPU_OPS[op].length;
+        if (end + length > PAGE_SIZE)
+            break;
+        entry->op = op;
+        entry->imm = 0;
+        if (op < 0x100 && length >= 2)
+            entry->imm = code[end + 1];
+        if (op < 0x100 && length == 3)
+            entry->imm |= code[end + 2] << 8;
+        end += length;
+        clocks += CPU_OPS[op].clocks;
+        entry->end = end - off;
+        entry->clocks = clocks;
+        b->count++;
+        if (block_ends_after(op))
+            break;
+    }
+    if (b->count == 0) {
+        b->code = NULL;
+        return false;
+    }
+
+    b->code = code + off;
+    b->pc = pc;
+#ifdef TRACING
+    /* Traces keep every iteration */
+    b->idle = false;
+#else
+    b->idle = block_is_idle(b);
+#endif
+#ifdef JIT
+    b->native = NULL;
+    b->runs = 0;
+#endif
+    /* Writable pages lose their fast write path until something writes to them */
+    if (bus_page_writable(bus, page))
+        bus_protect_code(bus, page);
+    b->gen = bus->page_gen[page];
+    return true;
+}
+
+const block_t *block_lookup(block_cache *self, bus *bus, uint16_t pc) {
+    const uint8_t *page = bus->read_map[pc >> PAGE_SHIFT];
+    block_t *b = &self->blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+
+    if (page == NULL)
+        return NULL;
+    if ((b->code != page + (pc & (PAGE_SIZE - 1)) || b->pc != pc ||
+         b->gen != bus->page_gen[pc >> PAGE_SHIFT]) &&
+        !block_build(b, bus, pc))
+        return NULL;
+#ifdef JIT
+    if (b->native == NULL && ++b->runs == JIT_THRESHOLD)
+        block_translate(self, b, bus);
+#endif
+    return b;
+}
+
+void block_cache_free(block_cache *self) {
+    if (self == NULL)
+        return;
+#ifdef JIT
+    jit_arena_free(self->jit);
+#endif
+    free(self);
+}
@@ -0,0 +1,64 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "bus.h"
+#include "cpu.h"
+#include "utils.h"
+#include <stdint.h>
+#ifdef JIT
+#include "jit.h"
+#endif
+
+/* Direct mapped by pc, a block replaces whatever was cached at the same index */
+#define BLOCK_CACHE_SIZE 0x1000
+#define BLOCK_MAX_OPS 16
+
+typedef struct {
+    /* Index into CPU_OPS, CB-prefixed opcodes are resolved to their own entry */
+    uint16_t op;
+    uint16_t imm;
+    /* Offset of the next instruction from the start of the block */
+    uint8_t end;
+    /* Clocks of this and every previous op, excluding those taken by branches */
+    uint8_t clocks;
+} block_op_t;
+
+/*
+ * Straight line run of instructions ending at the first branch, halt or interrupt toggle. Blocks
+ * never cross a page, so the host address of the first byte identifies the ROM bank or RAM the
+ * code was decoded from and gen, copied from the page_gen of the bus, detects writes to it.
+ */
+typedef struct block {
+    const uint8_t *code;
+    uint32_t gen;
+    uint16_t pc;
+    uint8_t count;
+    /*
+     * Set for loops branching back to their own start that only read registers they set earlier
+     * in the loop, or don't set at all, and memory that changes at events alone. Every iteration
+     * up to the next event then does exactly the same as the first one.
+     */
+    bool idle;
+    block_op_t ops[BLOCK_MAX_OPS];
+#ifdef JIT
+    /* Translation of the block once it ran JIT_THRESHOLD times, if it could be translated */
+    jit_fn native;
+    uint16_t runs;
+#endif
+} block_t;
+
+typedef struct block_cache {
+    block_t blocks[BLOCK_CACHE_SIZE];
+#ifdef JIT
+    jit_arena jit;
+#endif
+} block_cache;
+
+block_cache *block_cache_new();
+/* Drops every block, required when memory was modified without going through the bus */
+void block_cache_flush(block_cache *self);
+/* Block starting at pc, decoded on a miss. NULL if the code at pc isn't in a mapped page */
+const block_t *block_lookup(block_cache *self, bus *bus, uint16_t pc);
+void block_cache_free(block_cache *self);
+
+#endif
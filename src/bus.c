@@ -1,4 +1,6 @@
 #include "bus.h"
+#include "pixel.h"
+#include "trace.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,81 +27,422 @@ const uint8_t BOOTROM_DEFAULT[BOOTROM_SIZE] = {
 
 bus bus_new(cartridge_t cart) {
     bus b;
+    pixel_init();
     memcpy(b.bootrom, BOOTROM_DEFAULT, BOOTROM_SIZE);
     memset(b.vram, 0, VRAM_SIZE);
+    memset(b.tiles, 0, sizeof(b.tiles));
     memset(b.ram, 0, RAM_SIZE);
     memset(b.sat, 0, SAT_SIZE);
+    bus_index_objs(&b);
     memset(b.io, 0, IO_SIZE);
+    bus_decode_palettes(&b);
     memset(b.hram, 0, HRAM_SIZE);
     b.ie_reg = 0;
+    b.unmapped = 0xFF;
     b.cart = cart;
+    b.sched = NULL;
+    memset(b.raster_log, 0, sizeof(b.raster_log));
+    b.raster_count = 0;
+    b.div_reset = 0;
+    b.tima_synced = 0;
+    b.map_gen = 0;
+    memset(b.code_pages, 0, sizeof(b.code_pages));
+    memset(b.page_gen, 0, sizeof(b.page_gen));
+    /* Maps would point into this copy, so they are only built by bus_remap */
+    memset(b.read_map, 0, sizeof(b.read_map));
+    memset(b.write_map, 0, sizeof(b.write_map));
     return b;
 }
 
+void bus_map_bootrom(bus *self) {
+    self->map_gen++;
+    if (self->io[IO_BOOTROM_OFF] == 0)
+        self->read_map[0x00] = self->bootrom;
+    else
+        self->read_map[0x00] = cartridge_page_ptr(&self->cart, 0x0000, false);
+}
+
+/* Points the ROM and external RAM pages at the currently selected banks */
+void bus_map_cart(bus *self) {
+    uint16_t page;
+    for (page = 0x00; page <= 0x7F; page++)
+        self->read_map[page] = cartridge_page_ptr(&self->cart, page << PAGE_SHIFT, false);
+    for (page = 0xA0; page <= 0xBF; page++) {
+        self->read_map[page] = cartridge_page_ptr(&self->cart, page << PAGE_SHIFT, false);
+        self->write_map[page] = NULL;
+        if (!self->code_pages[page])
+            self->write_map[page] = cartridge_page_ptr(&self->cart, page << PAGE_SHIFT, true);
+    }
+    bus_map_bootrom(self);
+}
+
+bool bus_tile_page(uint8_t page) {
+    return page >= VRAM_START >> PAGE_SHIFT && page <= TILE_DATA_END >> PAGE_SHIFT;
+}
+
+void bus_remap(bus *self) {
+    uint16_t page;
+    memset(self->code_pages, 0, sizeof(self->code_pages));
+    for (page = 0; page < PAGE_COUNT; page++) {
+        uint16_t addr = page << PAGE_SHIFT;
+        uint8_t *mem = NULL;
+        if (addr >= 0x8000 && addr <= 0x9FFF)
+            mem = &self->vram[addr - VRAM_START];
+        else if (addr >= 0xC000 && addr <= 0xDFFF)
+            mem = &self->ram[addr - RAM_START];
+        else if (addr >= 0xE000 && addr <= 0xFDFF)
+            mem = &self->ram[addr - 0x2000 - RAM_START];
+        self->read_map[page] = mem;
+        self->write_map[page] = bus_tile_page(page) ? NULL : mem;
+    }
+    bus_map_cart(self);
+}
+
+bool bus_page_writable(bus *self, uint8_t page) {
+    return self->write_map[page] != NULL || bus_tile_page(page);
+}
+
+/* The page showing the same work RAM through echo RAM, or page itself */
+uint8_t bus_mirror_page(uint8_t page) {
+    if (page >= 0xC0 && page <= 0xDD)
+        return page + 0x20;
+    if (page >= 0xE0 && page <= 0xFD)
+        return page - 0x20;
+    return page;
+}
+
+void bus_protect_code(bus *self, uint8_t page) {
+    uint8_t mirror = bus_mirror_page(page);
+    self->code_pages[page] = true;
+    self->code_pages[mirror] = true;
+    self->write_map[page] = NULL;
+    self->write_map[mirror] = NULL;
+}
+
+/* Invalidates the blocks decoded from page and lets writes to it take the fast path again */
+void bus_unprotect_code(bus *self, uint8_t page) {
+    uint8_t mirror = bus_mirror_page(page);
+    self->code_pages[page] = false;
+    self->code_pages[mirror] = false;
+    /* Code pages are writable memory, mapped the same for reads and writes unless tile data */
+    if (!bus_tile_page(page)) {
+        self->write_map[page] = self->read_map[page];
+        self->write_map[mirror] = self->read_map[mirror];
+    }
+    self->page_gen[page]++;
+    if (mirror != page)
+        self->page_gen[mirror]++;
+    /* Ends the running block, it may have just overwritten its own code */
+    self->map_gen++;
+}
+
 uint8_t bus_read(bus *self, uint16_t addr) {
-    uint8_t ret = *bus_read_ptr(self, addr);
-    /* LOG("BUS", "Reading value %#04x from address %#06x", ret, addr); */
-    return ret;
+    uint8_t *page = self->read_map[addr >> PAGE_SHIFT];
+    if (page != NULL)
+        return page[addr & (PAGE_SIZE - 1)];
+    return *bus_read_ptr(self, addr);
+}
+
+/* Without a scheduler there is no clock, and the timer stands still */
+uintptr_t bus_now(bus *self) {
+    return self->sched != NULL ? scheduler_now(self->sched) : 0;
+}
+
+/* Clocks between two increments of TIMA, which counts on a falling edge of a divider bit */
+uintptr_t bus_tima_period(bus *self) {
+    static const uintptr_t PERIODS[] = {256, 4, 16, 64};
+    return PERIODS[self->io[IO_TAC_OFF] & TAC_CLOCK_MASK];
+}
+
+/* Whether the divider bit TIMA counts on is set, TIMA counts when it goes low while enabled */
+bool bus_tima_input(bus *self, uintptr_t divider) {
+    return (self->io[IO_TAC_OFF] & TAC_ENABLE) && (divider & (bus_tima_period(self) / 2));
+}
+
+/* Adds n increments to TIMA, reloading it from TMA and requesting an interrupt on overflow */
+void bus_tima_add(bus *self, uintptr_t n) {
+    uint8_t tima = self->io[IO_TIMA_OFF];
+    uint16_t reload = 0x100 - self->io[IO_TMA_OFF];
+    if (n < 0x100u - tima) {
+        self->io[IO_TIMA_OFF] = tima + n;
+        return;
+    }
+    n -= 0x100 - tima;
+    self->io[IO_TIMA_OFF] = self->io[IO_TMA_OFF] + n % reload;
+    self->io[IO_IF_OFF] |= INT_TIMER;
+}
+
+/* Brings DIV and TIMA up to date */
+void bus_timer_sync(bus *self) {
+    uintptr_t now = bus_now(self);
+    uintptr_t divider = now - self->div_reset;
+
+    self->io[IO_DIV_OFF] = divider / CLOCKS_PER_DIV;
+    if (self->io[IO_TAC_OFF] & TAC_ENABLE) {
+        uintptr_t period = bus_tima_period(self);
+        bus_tima_add(self, divider / period - (self->tima_synced - self->div_reset) / period);
+    }
+    self->tima_synced = now;
+}
+
+/* Schedules the next overflow of TIMA, which has to be up to date */
+void bus_timer_schedule(bus *self) {
+    uintptr_t period = bus_tima_period(self);
+    uintptr_t divider = self->tima_synced - self->div_reset;
+    uintptr_t ticks = 0x100 - self->io[IO_TIMA_OFF];
+
+    if (self->sched == NULL)
+        return;
+    if (!(self->io[IO_TAC_OFF] & TAC_ENABLE)) {
+        scheduler_cancel(self->sched, sched_timer_e);
+        return;
+    }
+    scheduler_schedule(self->sched, sched_timer_e,
+                       self->div_reset + (divider / period + ticks) * period);
+}
+
+/*
+ * Writes to the timer registers. Both resetting the divider and changing TAC can make the input
+ * of TIMA go low and count once more, just like on hardware.
+ */
+void bus_write_timer(bus *self, uint8_t off, uint8_t n) {
+    bool input;
+
+    bus_timer_sync(self);
+    input = bus_tima_input(self, self->tima_synced - self->div_reset);
+    switch (off) {
+    case IO_DIV_OFF:
+        self->div_reset = self->tima_synced;
+        self->io[IO_DIV_OFF] = 0;
+        break;
+    case IO_TAC_OFF:
+        self->io[IO_TAC_OFF] = n;
+        break;
+    default:
+        self->io[off] = n;
+        break;
+    }
+    if (input && !bus_tima_input(self, self->tima_synced - self->div_reset))
+        bus_tima_add(self, 1);
+    bus_timer_schedule(self);
+}
+
+void bus_timer_overflow(bus *self) {
+    bus_timer_sync(self);
+    bus_timer_schedule(self);
+}
+
+/* Decodes the row of the tile holding VRAM offset off */
+void bus_decode_tile_row(bus *self, uint16_t off) {
+    uint8_t *row = self->tiles[off / TILE_SIZE][(off % TILE_SIZE) / 2];
+    PIXEL_KERNELS.decode_rows(&self->vram[off & ~1], row, 1);
+}
+
+void bus_decode_tiles(bus *self) {
+    /* Rows are laid out in the cache in the same order as in VRAM */
+    PIXEL_KERNELS.decode_rows(self->vram, self->tiles[0][0], TILE_COUNT * 8);
+}
+
+/* Splits palette register i into the shades of the four colour indices */
+void bus_decode_palette(bus *self, uint8_t i) {
+    uint8_t reg = self->io[IO_BGP_OFF + i];
+    uint8_t idx;
+    for (idx = 0; idx < 4; idx++)
+        self->palettes[i][idx] = (reg >> (idx * 2)) & 0x03;
+}
+
+void bus_decode_palettes(bus *self) {
+    uint8_t i;
+    for (i = 0; i < PALETTE_COUNT; i++)
+        bus_decode_palette(self, i);
+}
+
+void bus_index_objs(bus *self) {
+    uint8_t i;
+    memset(self->objs_by_y, 0, sizeof(self->objs_by_y));
+    for (i = 0; i < OBJ_COUNT; i++)
+        self->objs_by_y[self->sat[i * OBJ_SIZE]] |= (uint64_t)1 << i;
+}
+
+/* Moves a sprite whose Y position changes to its new place in objs_by_y */
+void bus_write_oam(bus *self, uint8_t off, uint8_t n) {
+    if (off % OBJ_SIZE == 0) {
+        self->objs_by_y[self->sat[off]] &= ~((uint64_t)1 << (off / OBJ_SIZE));
+        self->objs_by_y[n] |= (uint64_t)1 << (off / OBJ_SIZE);
+    }
+    self->sat[off] = n;
+}
+
+bool bus_read_is_stable(uint16_t addr) {
+    /* The timer counts with every clock */
+    return addr != IO_START + IO_DIV_OFF && addr != IO_START + IO_TIMA_OFF;
 }
 
 uint8_t *bus_read_ptr(bus *self, uint16_t addr) {
-    uint8_t *val;
-    if (addr >= 0x0000 && addr <= 0x100) {
-        if (self->io[addr % IO_START] == 0)
-            val = &self->bootrom[addr];
-        else
-            val = cartridge_read_ptr(&self->cart, addr);
-    } else if (addr >= 0x0101 && addr <= 0x7FFF)
-        val = cartridge_read_ptr(&self->cart, addr);
-    else if (addr >= 0x8000 && addr <= 0x9FFF)
-        val = &self->vram[addr % VRAM_START];
-    else if (addr >= 0xA000 && addr <= 0xBFFF)
-        val = cartridge_read_ptr(&self->cart, addr);
-    else if (addr >= 0xC000 && addr <= 0xDFFF)
-        val = &self->ram[addr % RAM_START];
-    else if (addr >= 0xE000 && addr <= 0xFDFF)
-        val = &self->ram[(addr - 0x2000) % RAM_START];
+    uint8_t *page = self->read_map[addr >> PAGE_SHIFT];
+    if (page != NULL)
+        return &page[addr & (PAGE_SIZE - 1)];
+
+    if (addr <= 0x7FFF || (addr >= 0xA000 && addr <= 0xBFFF))
+        return cartridge_read_ptr(&self->cart, addr);
     else if (addr >= 0xFE00 && addr <= 0xFE9F)
-        val = &self->sat[addr % SAT_START];
-    else if (addr >= 0xFEA0 && addr <= 0xFEFF)
-        return 0x00;
-    else if (addr >= 0xFF00 && addr <= 0xFF7F)
-        val = &self->io[addr % IO_START];
-    else if (addr >= 0xFF80 && addr <= 0xFFFE)
-        val = &self->hram[addr % HRAM_START];
-    else
-        val = &self->ie_reg;
+        return &self->sat[addr - SAT_START];
+    else if (addr >= 0xFF00 && addr <= 0xFF7F) {
+        if (addr == IO_START + IO_DIV_OFF || addr == IO_START + IO_TIMA_OFF)
+            bus_timer_sync(self);
+        return &self->io[addr - IO_START];
+    } else if (addr >= 0xFF80 && addr <= 0xFFFE)
+        return &self->hram[addr - HRAM_START];
+    else if (addr == 0xFFFF)
+        return &self->ie_reg;
+    /* Unusable OAM range */
+    return &self->unmapped;
+}
 
-    return val;
+/*
+ * Interrupts are only checked between blocks. Bumping map_gen ends the running one, so one that
+ * a write to IF or IE just made pending is taken after the writing instruction.
+ */
+void bus_end_block(bus *self) {
+    self->map_gen++;
 }
 
-void bus_write(bus *self, uint16_t addr, uint8_t n) {
-    /* LOG("BUS", "Writing value %#04x to address %#06x", n, addr); */
-    if (0x0000 <= addr && addr <= 0x100) {
-        if (self->io[addr % IO_START] == 0)
-            self->bootrom[addr] = n;
+/* Records a write to a register the renderer reads, if the PPU is drawing */
+void bus_log_raster_write(bus *self, uint8_t off, uint8_t n) {
+    raster_write_t *entry;
+    uint8_t i;
+
+    if ((self->io[IO_STAT_OFF] & STAT_MODE_MASK) != STAT_MODE_DRAW)
+        return;
+    if (self->raster_count == RASTER_LOG_SIZE) {
+        /* Folded into the last logged write to the register, or left for the whole line */
+        for (i = RASTER_LOG_SIZE; i-- > 0;)
+            if (self->raster_log[i].reg == off) {
+                self->raster_log[i].value = n;
+                break;
+            }
+        return;
+    }
+    entry = &self->raster_log[self->raster_count];
+    entry->when = bus_now(self);
+    entry->reg = off;
+    entry->old = self->io[off];
+    entry->value = n;
+    self->raster_count++;
+}
+
+/* Transfers and DMA finish at once when the bus is used without a scheduler */
+void bus_write_io(bus *self, uint8_t off, uint8_t n) {
+    switch (off) {
+    case IO_DIV_OFF:
+    case IO_TIMA_OFF:
+    case IO_TMA_OFF:
+    case IO_TAC_OFF:
+        bus_write_timer(self, off, n);
+        return;
+    case IO_STAT_OFF:
+        n = (n & STAT_WRITABLE) | (self->io[IO_STAT_OFF] & ~STAT_WRITABLE);
+        break;
+    case IO_LY_OFF:
+        /* Read only, counted by the PPU alone */
+        return;
+#ifndef PPU_FIFO
+    /* The FIFO engine reads these as it draws and needs no log */
+    case IO_LCDC_OFF:
+    case IO_SCY_OFF:
+    case IO_SCX_OFF:
+    case IO_BGP_OFF:
+    case IO_OBP0_OFF:
+    case IO_OBP1_OFF:
+    case IO_WY_OFF:
+    case IO_WX_OFF:
+        bus_log_raster_write(self, off, n);
+        break;
+#endif
+    }
+    self->io[off] = n;
+    switch (off) {
+    case IO_SC_OFF:
+        /* Only transfers on the internal clock finish, there is never a peer to clock them */
+        if ((n & 0x81) != 0x81)
+            break;
+        if (self->sched != NULL)
+            scheduler_schedule(self->sched, sched_serial_e,
+                               scheduler_now(self->sched) + CLOCKS_PER_SERIAL);
         else
-            cartridge_write(&self->cart, addr, n);
-    } else if (0x0101 <= addr && addr <= 0x7FFF)
-        cartridge_write(&self->cart, addr, n);
-    else if (0x8000 <= addr && addr <= 0x9FFF)
-        self->vram[addr % VRAM_START] = n;
-    else if (0xA000 <= addr && addr <= 0xBFFF)
-        PANIC("attempted to write from cartridge");
-    else if (0xC000 <= addr && addr <= 0xDFFF)
-        self->ram[addr % RAM_START] = n;
-    else if (0xE000 <= addr && addr <= 0xFDFF)
-        self->ram[(addr - 0x2000) % RAM_START] = n;
-    else if (0xFE00 <= addr && addr <= 0xFE9F)
-        self->sat[addr % SAT_START] = n;
+            bus_serial_complete(self);
+        break;
+    case IO_DMA_OFF:
+        if (self->sched != NULL)
+            scheduler_schedule(self->sched, sched_dma_e,
+                               scheduler_now(self->sched) + CLOCKS_PER_DMA);
+        else
+            bus_dma_complete(self);
+        break;
+    case IO_IF_OFF:
+        bus_end_block(self);
+        break;
+    case IO_BGP_OFF:
+    case IO_OBP0_OFF:
+    case IO_OBP1_OFF:
+        bus_decode_palette(self, off - IO_BGP_OFF);
+        break;
+    case IO_BOOTROM_OFF:
+        bus_map_bootrom(self);
+        break;
+    }
+}
+
+void bus_serial_complete(bus *self) {
+    /* Nothing is connected, so every bit shifted in is 1 */
+    self->io[IO_SB_OFF] = 0xFF;
+    self->io[IO_SC_OFF] &= ~0x80;
+    self->io[IO_IF_OFF] |= INT_SERIAL;
+}
+
+void bus_dma_complete(bus *self) {
+    uint16_t src = self->io[IO_DMA_OFF] << 8;
+    uint8_t i;
+    for (i = 0; i < SAT_SIZE; i++)
+        self->sat[i] = bus_read(self, src + i);
+    bus_index_objs(self);
+}
+
+void bus_write(bus *self, uint16_t addr, uint8_t n) {
+    uint8_t *page = self->write_map[addr >> PAGE_SHIFT];
+    TRACE(TRACE_BUS, trace_write_e, addr, 0, n);
+    if (page != NULL) {
+        page[addr & (PAGE_SIZE - 1)] = n;
+        return;
+    }
+
+    if (self->code_pages[addr >> PAGE_SHIFT]) {
+        bus_unprotect_code(self, addr >> PAGE_SHIFT);
+        /* Still unmapped if external RAM was disabled since the code was decoded */
+        page = self->write_map[addr >> PAGE_SHIFT];
+        if (page != NULL) {
+            page[addr & (PAGE_SIZE - 1)] = n;
+            return;
+        }
+    }
+    if (addr <= 0x7FFF || (0xA000 <= addr && addr <= 0xBFFF)) {
+        if (cartridge_write(&self->cart, addr, n))
+            bus_map_cart(self);
+    } else if (VRAM_START <= addr && addr <= TILE_DATA_END) {
+        self->vram[addr - VRAM_START] = n;
+        bus_decode_tile_row(self, addr - VRAM_START);
+    } else if (0xFE00 <= addr && addr <= 0xFE9F)
+        bus_write_oam(self, addr - SAT_START, n);
     else if (0xFEA0 <= addr && addr <= 0xFEFF)
         PANIC("unhandled");
     else if (0xFF00 <= addr && addr <= 0xFF7F)
-        self->io[addr % IO_START] = n;
+        bus_write_io(self, addr - IO_START, n);
     else if (0xFF80 <= addr && addr <= 0xFFFE)
-        self->hram[addr % HRAM_START] = n;
-    else
+        self->hram[addr - HRAM_START] = n;
+    else {
         self->ie_reg = n;
+        bus_end_block(self);
+    }
 }
 
 void bus_free(bus self) {
@@ -2,35 +2,168 @@
 #define BUS_H
 
 #include "cartridge.h"
+#include "scheduler.h"
 #include <stdint.h>
 
 #define BOOTROM_SIZE 0x0100
-#define VRAM_SIZE 0x8000
+#define VRAM_SIZE 0x2000
 #define VRAM_START 0x8000
-#define RAM_SIZE 0x8000
+/* Tile data, 16 bytes for each tile of 8x8 pixels */
+#define TILE_DATA_END 0x97FF
+#define TILE_COUNT 384
+#define TILE_SIZE 16
+#define RAM_SIZE 0x2000
 #define RAM_START 0xC000
 #define SAT_SIZE 0x00A0
 #define SAT_START 0xFE00
+/* Sprites, 4 bytes each starting with the Y position */
+#define OBJ_COUNT 40
+#define OBJ_SIZE 4
 #define IO_SIZE 0x0080
 #define IO_START 0xFF00
 #define HRAM_SIZE 0x0080
 #define HRAM_START 0xFF80
 
+#define PAGE_SHIFT 8
+#define PAGE_SIZE (1 << PAGE_SHIFT)
+#define PAGE_COUNT (0x10000 >> PAGE_SHIFT)
+
+#define IO_SB_OFF 0x01
+#define IO_SC_OFF 0x02
+#define IO_DIV_OFF 0x04
+#define IO_TIMA_OFF 0x05
+#define IO_TMA_OFF 0x06
+#define IO_TAC_OFF 0x07
+#define IO_IF_OFF 0x0F
+#define IO_LCDC_OFF 0x40
+#define IO_STAT_OFF 0x41
+#define IO_SCY_OFF 0x42
+#define IO_SCX_OFF 0x43
+#define IO_LY_OFF 0x44
+#define IO_DMA_OFF 0x46
+#define IO_BGP_OFF 0x47
+#define IO_OBP0_OFF 0x48
+#define IO_OBP1_OFF 0x49
+#define IO_WY_OFF 0x4A
+#define IO_WX_OFF 0x4B
+#define IO_BOOTROM_OFF 0x50
+
+/* Interrupt sources, as bits of IF and IE in order of priority */
+#define INT_VBLANK 0x01
+#define INT_STAT 0x02
+#define INT_TIMER 0x04
+#define INT_SERIAL 0x08
+#define INT_JOYPAD 0x10
+#define INT_MASK 0x1F
+
+/* 8 bits at 8192 Hz */
+#define CLOCKS_PER_SERIAL 1024
+#define CLOCKS_PER_DMA SAT_SIZE
+/* DIV is the upper byte of a divider counting at 4 times the CPU clock */
+#define CLOCKS_PER_DIV 64
+#define TAC_ENABLE 0x04
+#define TAC_CLOCK_MASK 0x03
+/* Palettes in the order of their registers */
+#define PALETTE_BGP 0
+#define PALETTE_OBP0 1
+#define PALETTE_OBP1 2
+#define PALETTE_COUNT 3
+/* The mode bits of STAT while the PPU is drawing */
+#define STAT_MODE_MASK 0x03
+#define STAT_MODE_DRAW 0x03
+/* Only the interrupt sources, the mode and LYC == LY flag belong to the PPU */
+#define STAT_WRITABLE 0x78
+/* More writes than fit in one draw period */
+#define RASTER_LOG_SIZE 32
+
+typedef struct {
+    /* Clock of the write, the renderer turns it into a pixel position */
+    uintptr_t when;
+    uint8_t reg;
+    /* Value before the write, so the renderer can rewind to the start of the line */
+    uint8_t old;
+    uint8_t value;
+} raster_write_t;
+
 typedef struct bus {
+    /*
+     * Host pointer to the start of every 256 byte page, or NULL when accesses to the page have
+     * side effects (I/O, cartridge control) and have to go through the slow path. Bank switches
+     * only repoint the cartridge pages.
+     */
+    uint8_t *read_map[PAGE_COUNT];
+    uint8_t *write_map[PAGE_COUNT];
     uint8_t bootrom[BOOTROM_SIZE];
     uint8_t vram[VRAM_SIZE];
-    uint8_t ram[RAM_START];
-    uint8_t sat[SAT_START];
+    /*
+     * Colour index (0-3) of every pixel of every tile, decoded from the two bit planes in VRAM.
+     * Writes to tile data take the slow path to keep it up to date.
+     */
+    uint8_t tiles[TILE_COUNT][8][8];
+    uint8_t ram[RAM_SIZE];
+    uint8_t sat[SAT_SIZE];
+    /*
+     * Bit i of objs_by_y[y] is set when sprite i has Y position y, lets the PPU find the sprites
+     * on a line without scanning OAM. Writes to OAM and DMA keep it up to date.
+     */
+    uint64_t objs_by_y[0x100];
     uint8_t io[IO_SIZE];
+    /* Shade of every colour index under each palette register, rebuilt when it is written */
+    uint8_t palettes[PALETTE_COUNT][4];
+    /*
+     * Writes to the registers the renderer reads, made while the PPU draws the current line.
+     * The line is rendered at once at the end of the draw period and replays them in order.
+     */
+    raster_write_t raster_log[RASTER_LOG_SIZE];
+    uint8_t raster_count;
     uint8_t hram[HRAM_SIZE];
     uint8_t ie_reg;
+    /* Backs reads of unmapped addresses */
+    uint8_t unmapped;
     cartridge_t cart;
+    /* Incremented whenever a page is repointed, lets the CPU validate its cached code page */
+    uint32_t map_gen;
+    /*
+     * Writable pages holding decoded blocks are left out of write_map, the first write to one
+     * restores it and bumps its page_gen, invalidating the blocks.
+     */
+    bool code_pages[PAGE_COUNT];
+    uint32_t page_gen[PAGE_COUNT];
+    /* Completion of serial transfers and DMA and timer overflows are scheduled here */
+    scheduler *sched;
+    /*
+     * The timer never ticks. DIV and TIMA are brought up to date when read or written from the
+     * clock the divider was last reset at and the clock TIMA was last brought up to date at.
+     */
+    uintptr_t div_reset;
+    uintptr_t tima_synced;
 } bus;
 
 bus bus_new(cartridge_t cart);
+/*
+ * Rebuilds the page maps, required once the bus is at its final address. Drops the write
+ * protection of code pages, so decoded blocks have to be flushed along with it.
+ */
+void bus_remap(bus *self);
+/* Whether page is memory writes can modify, whether or not they take the fast path */
+bool bus_page_writable(bus *self, uint8_t page);
+/* Routes writes to page, and its echo RAM mirror, through the slow path */
+void bus_protect_code(bus *self, uint8_t page);
+/* Decodes every tile again, required when VRAM was modified without going through the bus */
+void bus_decode_tiles(bus *self);
+/* Rebuilds palettes, required when the registers were modified without going through the bus */
+void bus_decode_palettes(bus *self);
+/* Indexes every sprite again, required when OAM was modified without going through the bus */
+void bus_index_objs(bus *self);
 uint8_t bus_read(bus *self, uint16_t addr);
+/* False for registers that change on their own, without a write or a scheduled event */
+bool bus_read_is_stable(uint16_t addr);
 uint8_t *bus_read_ptr(bus *self, uint16_t addr);
 void bus_write(bus *self, uint16_t addr, uint8_t n);
+/* Handlers for the events scheduled by I/O writes */
+void bus_serial_complete(bus *self);
+void bus_dma_complete(bus *self);
+void bus_timer_overflow(bus *self);
 void bus_free(bus self);
 
 #endif
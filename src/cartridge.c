@@ -7,6 +7,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 cartridge_t cartridge_new(char *path) {
     cartridge_t c;
@@ -24,17 +25,56 @@ cartridge_t cartridge_new(char *path) {
         struct stat s;
 
         fd = open(path, O_RDONLY);
+        if (fd < 0)
+            PANIC("could not open %s", path);
         fstat(fd, &s);
-        c.data = mmap(NULL, s.st_size, PROT_WRITE, MAP_PRIVATE, fd, 0);
+        c.data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
         c.size = s.st_size;
+        close(fd);
         if (c.data == MAP_FAILED)
             PANIC("mmap failed");
     }
+    if (c.size < 2 * ROM_BANK_SIZE)
+        PANIC("rom is smaller than two banks");
 
+    c.mbc = mbc_new(c.data[CART_TYPE_ADDR]);
+    c.rom_banks = c.size / ROM_BANK_SIZE;
+    c.ram_size = mbc_ram_size(&c.mbc, c.data[CART_RAM_SIZE_ADDR]);
+    c.ram = NULL;
+    if (c.ram_size != 0) {
+        c.ram = malloc(c.ram_size);
+        if (c.ram == NULL)
+            PANIC("allocating cartridge ram failed");
+        memset(c.ram, 0xFF, c.ram_size);
+    }
+    c.open_bus = 0xFF;
+    c.refs = malloc(sizeof(uintptr_t));
+    if (c.refs == NULL)
+        PANIC("allocating cartridge failed");
+    *c.refs = 1;
+    mbc_update(&c);
+
+    return c;
+}
+
+cartridge_t cartridge_clone(cartridge_t *self) {
+    cartridge_t c = *self;
+    if (c.ram_size != 0) {
+        c.ram = malloc(c.ram_size);
+        if (c.ram == NULL)
+            PANIC("allocating cartridge ram failed");
+        memcpy(c.ram, self->ram, c.ram_size);
+    }
+    (*c.refs)++;
+    mbc_update(&c);
     return c;
 }
 
 void cartridge_free(cartridge_t self) {
+    free(self.ram);
+    if (--(*self.refs) != 0)
+        return;
+    free(self.refs);
     if (self.path == NULL)
         free(self.data);
     else
@@ -42,12 +82,46 @@ void cartridge_free(cartridge_t self) {
 }
 
 uint8_t *cartridge_read_ptr(cartridge_t *self, uint16_t addr) {
-    return &self->data[addr];
+    if (addr <= 0x3FFF)
+        return &self->rom0[addr];
+    if (addr <= 0x7FFF)
+        return &self->romx[addr - 0x4000];
+
+    if (!self->mbc.ram_enable)
+        return &self->open_bus;
+    if (self->mbc.type == mbc2_e)
+        return &self->ram[addr & (MBC2_RAM_SIZE - 1)];
+    if (self->mbc.type == mbc3_e && self->mbc.ram_bank >= 0x08 && self->mbc.ram_bank <= 0x0C)
+        return &self->mbc.rtc_latched[self->mbc.ram_bank - 0x08];
+    if (self->sram != NULL)
+        return &self->sram[addr - 0xA000];
+    return &self->open_bus;
+}
+
+uint8_t *cartridge_page_ptr(cartridge_t *self, uint16_t addr, bool write) {
+    if (addr <= 0x7FFF)
+        return write ? NULL : cartridge_read_ptr(self, addr & ~0xFF);
+    if (self->sram == NULL)
+        return NULL;
+    return &self->sram[(addr & ~0xFF) - 0xA000];
 }
+
 uint8_t cartridge_read(cartridge_t *self, uint16_t addr) {
     return *cartridge_read_ptr(self, addr);
 }
 
-void cartridge_write(cartridge_t *self, uint16_t addr, uint8_t n) {
-    self->data[addr] = n;
+bool cartridge_write(cartridge_t *self, uint16_t addr, uint8_t n) {
+    if (addr <= 0x7FFF)
+        return mbc_write(self, addr, n);
+
+    if (!self->mbc.ram_enable)
+        return false;
+    if (self->mbc.type == mbc2_e)
+        /* Only the lower nibble exists, the upper one reads back as 1s */
+        self->ram[addr & (MBC2_RAM_SIZE - 1)] = n | 0xF0;
+    else if (self->mbc.type == mbc3_e && self->mbc.ram_bank >= 0x08 && self->mbc.ram_bank <= 0x0C)
+        self->mbc.rtc[self->mbc.ram_bank - 0x08] = n;
+    else if (self->sram != NULL)
+        self->sram[addr - 0xA000] = n;
+    return false;
 }
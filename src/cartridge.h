@@ -1,6 +1,8 @@
 #ifndef CARTRIDGE_H
 #define CARTRIDGE_H
 
+#include "mbc.h"
+#include "utils.h"
 #include <stddef.h>
 #include <stdint.h>
 
@@ -8,12 +10,34 @@ typedef struct cartridge_t {
     uint8_t *data;
     size_t size;
     char *path;
+    /* Number of cartridges sharing data, it is released with the last one */
+    uintptr_t *refs;
+    mbc_t mbc;
+    /* External RAM, MBC2 keeps its 512 nibbles here as well */
+    uint8_t *ram;
+    size_t ram_size;
+    uint16_t rom_banks;
+    /*
+     * Base of the banks currently mapped at 0x0000, 0x4000 and 0xA000. sram is NULL when external
+     * RAM is disabled or isn't plain memory (MBC2, MBC3 clock registers).
+     */
+    uint8_t *rom0;
+    uint8_t *romx;
+    uint8_t *sram;
+    /* Read by disabled or missing external RAM */
+    uint8_t open_bus;
 } cartridge_t;
 
 cartridge_t cartridge_new(char *path);
+/* Shares the ROM image with self but gets its own copy of external RAM */
+cartridge_t cartridge_clone(cartridge_t *self);
 void cartridge_free(cartridge_t self);
+/* Host pointer to the byte at addr in 0x0000-0x7FFF or 0xA000-0xBFFF */
 uint8_t *cartridge_read_ptr(cartridge_t *self, uint16_t addr);
+/* Host pointer to the 256 byte page holding addr, or NULL if it has to go through the slow path */
+uint8_t *cartridge_page_ptr(cartridge_t *self, uint16_t addr, bool write);
 uint8_t cartridge_read(cartridge_t *self, uint16_t addr);
-void cartridge_write(cartridge_t *self, uint16_t addr, uint8_t n);
+/* Returns true when the write switched banks and the bus mappings are stale */
+bool cartridge_write(cartridge_t *self, uint16_t addr, uint8_t n);
 
 #endif
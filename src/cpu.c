@@ -1,8 +1,11 @@
 #include "cpu.h"
+#include "block.h"
 #include "decoder.h"
 #include "instruction.h"
 #include "stdio.h"
+#include "trace.h"
 #include "utils.h"
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,40 +13,43 @@ void cpu_write_bus(cpu *self, uint16_t addr, uint8_t n);
 uint8_t cpu_read_bus(cpu *self, uint16_t addr);
 
 __attribute((always_inline)) uint8_t get_reg_a(cpu *self) {
-    return self->af.u8.a;
+    return self->regs[REG_A];
 }
 __attribute((always_inline)) uint8_t get_reg_f(cpu *self) {
-    return self->af.u8.f.u8;
+    return self->regs[REG_F];
 }
 __attribute((always_inline)) uint8_t get_reg_b(cpu *self) {
-    return self->bc.u8.b;
+    return self->regs[REG_B];
 }
 __attribute((always_inline)) uint8_t get_reg_c(cpu *self) {
-    return self->bc.u8.c;
+    return self->regs[REG_C];
 }
 __attribute((always_inline)) uint8_t get_reg_d(cpu *self) {
-    return self->de.u8.d;
+    return self->regs[REG_D];
 }
 __attribute((always_inline)) uint8_t get_reg_e(cpu *self) {
-    return self->de.u8.e;
+    return self->regs[REG_E];
 }
 __attribute((always_inline)) uint8_t get_reg_h(cpu *self) {
-    return self->hl.u8.h;
+    return self->regs[REG_H];
 }
 __attribute((always_inline)) uint8_t get_reg_l(cpu *self) {
-    return self->hl.u8.l;
+    return self->regs[REG_L];
+}
+uint16_t get_reg_rr(cpu *self, uint8_t rr) {
+    return self->regs[rr] << 8 | self->regs[rr + 1];
 }
 uint16_t get_reg_af(cpu *self) {
-    return self->af.u16;
+    return get_reg_a(self) << 8 | cpu_get_f(self);
 }
 uint16_t get_reg_bc(cpu *self) {
-    return self->bc.u16;
+    return get_reg_rr(self, REG_BC);
 }
 uint16_t get_reg_de(cpu *self) {
-    return self->de.u16;
+    return get_reg_rr(self, REG_DE);
 }
 uint16_t get_reg_hl(cpu *self) {
-    return self->hl.u16;
+    return get_reg_rr(self, REG_HL);
 }
 uint16_t get_reg_sp(cpu *self) {
     return self->sp;
@@ -57,76 +63,79 @@ uint16_t get_sp_u16(cpu *self) {
     return hi << 8 | lo;
 }
 uint16_t get_pc(cpu *self) {
-    return self->decoder.idx;
+    return self->pc;
 }
 uint8_t get_flag_z(cpu *self) {
-    return self->af.u8.f.bits.z;
+    return (cpu_get_f(self) & FLAG_Z) != 0;
 }
 uint8_t get_flag_n(cpu *self) {
-    return self->af.u8.f.bits.n;
+    return (cpu_get_f(self) & FLAG_N) != 0;
 }
 uint8_t get_flag_h(cpu *self) {
-    return self->af.u8.f.bits.h;
+    return (cpu_get_f(self) & FLAG_H) != 0;
 }
+/* Carry is read by every adc, sbc and rotate through it, so it's derived without the rest of F */
 uint8_t get_flag_c(cpu *self) {
-    return self->af.u8.f.bits.c;
+    if (self->flag_op == flags_f_e)
+        return (get_reg_f(self) & FLAG_C) != 0;
+    return (self->flag_res >> 8) & 0x1;
 }
 void set_reg_a(cpu *self, uint8_t n) {
-    self->af.u8.a = n;
+    self->regs[REG_A] = n;
 }
 void set_reg_f(cpu *self, uint8_t n) {
-    self->af.u8.f.u8 = n;
+    self->regs[REG_F] = n;
 }
 void set_reg_b(cpu *self, uint8_t n) {
-    self->bc.u8.b = n;
+    self->regs[REG_B] = n;
 }
 void set_reg_c(cpu *self, uint8_t n) {
-    self->bc.u8.c = n;
+    self->regs[REG_C] = n;
 }
 void set_reg_d(cpu *self, uint8_t n) {
-    self->de.u8.d = n;
+    self->regs[REG_D] = n;
 }
 void set_reg_e(cpu *self, uint8_t n) {
-    self->de.u8.e = n;
+    self->regs[REG_E] = n;
 }
 void set_reg_h(cpu *self, uint8_t n) {
-    self->hl.u8.h = n;
+    self->regs[REG_H] = n;
 }
 void set_reg_l(cpu *self, uint8_t n) {
-    self->hl.u8.l = n;
+    self->regs[REG_L] = n;
+}
+void set_reg_rr(cpu *self, uint8_t rr, uint16_t n) {
+    self->regs[rr] = n >> 8;
+    self->regs[rr + 1] = n & 0xFF;
 }
 void set_reg_af(cpu *self, uint16_t n) {
-    self->af.u16 = n;
+    set_reg_a(self, n >> 8);
+    cpu_set_f(self, n & 0xFF);
 }
 void set_reg_bc(cpu *self, uint16_t n) {
-    self->bc.u16 = n;
+    set_reg_rr(self, REG_BC, n);
 }
 void set_reg_de(cpu *self, uint16_t n) {
-    self->de.u16 = n;
+    set_reg_rr(self, REG_DE, n);
 }
 void set_reg_hl(cpu *self, uint16_t n) {
-    self->hl.u16 = n;
+    set_reg_rr(self, REG_HL, n);
 }
 void set_reg_sp(cpu *self, uint16_t n) {
     self->sp = n;
 }
-void set_flag_z(cpu *self, bool z) {
-    self->af.u8.f.bits.z = z;
-}
-void set_flag_n(cpu *self, bool z) {
-    self->af.u8.f.bits.n = z;
-}
-void set_flag_h(cpu *self, bool z) {
-    self->af.u8.f.bits.h = z;
+/* Records an add or sub, res holds the carry or borrow out of bit 7 in bit 8 as with every kind */
+void set_flags_lazy(cpu *self, int kind, uint8_t lhs, uint8_t rhs, uint16_t res) {
+    self->flag_op = kind;
+    self->flag_lhs = lhs;
+    self->flag_rhs = rhs;
+    self->flag_res = res;
 }
-void set_flag_c(cpu *self, bool z) {
-    self->af.u8.f.bits.c = z;
-}
-void set_flag_h_add(cpu *self, uint16_t a, uint16_t b) {
-    set_flag_h(self, (get_reg_f(self) & ((((a & 0xf0) + (b & 0xf0)) & 0x100) == 0x100 << 4)) == 1);
-}
-void set_flag_c_add(cpu *self, uint16_t a, uint16_t b) {
-    set_flag_c(self, (get_reg_f(self) & ((((a & 0xf) + (b & 0xf)) & 0x10) == 0x10)) == 1);
+/* Records an op setting Z from res and every other flag to those in f */
+void set_flags_zero(cpu *self, uint8_t res, uint8_t f) {
+    self->flag_op = flags_zero_e;
+    self->flag_lhs = f;
+    self->flag_res = res | (f & FLAG_C) << 4;
 }
 void set_sp(cpu *self, uint16_t n) {
     self->sp = n;
@@ -139,20 +148,67 @@ void set_sp_u16(cpu *self, uint16_t n) {
     cpu_write_bus(self, --self->sp, (n >> 8) & 0x00FF);
 }
 void set_pc(cpu *self, uint16_t n) {
-    self->decoder.idx = n;
+    self->pc = n;
 }
 
+uint8_t cpu_get_f(cpu *self) {
+    uint16_t res = self->flag_res;
+    /* Carries into bit 4 and out of bit 7 show up in the operands xor'ed with the result */
+    uint8_t carries = self->flag_lhs ^ self->flag_rhs ^ res;
+    uint8_t f;
+
+    switch (self->flag_op) {
+    case flags_add_e:
+        f = ((carries & 0x10) << 1) | ((res >> 4) & FLAG_C);
+        break;
+    case flags_sub_e:
+        f = FLAG_N | ((carries & 0x10) << 1) | ((res >> 4) & FLAG_C);
+        break;
+    case flags_zero_e:
+        f = self->flag_lhs;
+        break;
+    default:
+        return get_reg_f(self);
+    }
+    if ((res & 0xFF) == 0)
+        f |= FLAG_Z;
+    cpu_set_f(self, f);
+    return f;
+}
+
+void cpu_set_f(cpu *self, uint8_t n) {
+    /* The low nibble of F always reads back as 0 */
+    set_reg_f(self, n & 0xF0);
+    self->flag_op = flags_f_e;
+}
+
+/* Resolved register operands are indices into regs, see REG_B */
+#define REG8(self, r) ((self)->regs[r])
+
+op_t CPU_OPS[0x200];
+
+void cpu_init_ops();
+
 cpu cpu_new(bus *bus) {
     cpu c;
-    c.af.u16 = 0x0000;
-    c.bc.u16 = 0x0000;
-    c.de.u16 = 0x0000;
-    c.hl.u16 = 0x0000;
+    cpu_init_ops();
+    memset(c.regs, 0, sizeof(c.regs));
     c.sp = 0xFFFE;
+    c.flag_op = flags_f_e;
+    c.flag_lhs = 0;
+    c.flag_rhs = 0;
+    c.flag_res = 0;
     c.mode = cpu_running_mode_e;
     c.bus = bus;
     c.clocks = 0x0000;
-    c.decoder = decoder_new(bus->bootrom, BOOTROM_SIZE);
+    c.pc = 0x0000;
+    c.code_page = NULL;
+    c.code_page_num = PAGE_COUNT;
+    c.code_map_gen = 0;
+    c.ime = false;
+    c.ei_delay = false;
+    c.imm = 0;
+    c.blocks = NULL;
     return c;
 }
 
@@ -164,858 +220,1106 @@ uint8_t cpu_read_bus(cpu *self, uint16_t addr) {
     return bus_read(self->bus, addr);
 }
 
-uint16_t get_rhs(cpu *self, argument_t *rhs) {
-    switch (rhs->e) {
-    case none_e:
-        PANIC("Attempted to read from none_e rhs!");
-        return 0;
-    case condition_e:
-        PANIC("Attempted to read from condition_e rhs!");
-        return 0;
-    case register_e:
-        switch (rhs->p.register_p) {
-        case a_register_p:
-            return get_reg_a(self);
-        case f_register_p:
-            return get_reg_f(self);
-        case b_register_p:
-            return get_reg_b(self);
-        case c_register_p:
-            return get_reg_c(self);
-        case d_register_p:
-            return get_reg_d(self);
-        case e_register_p:
-            return get_reg_e(self);
-        case h_register_p:
-            return get_reg_h(self);
-        case l_register_p:
-            return get_reg_l(self);
-        case af_register_p:
-            return get_reg_af(self);
-        case bc_register_p:
-            return get_reg_bc(self);
-        case de_register_p:
-            return get_reg_de(self);
-        case hl_register_p:
-            return get_reg_hl(self);
-        case sp_register_p:
-            return get_reg_sp(self);
-        }
-    case io_offset_u8_e:
-        return bus_read(self->bus, 0xff00 + rhs->p.io_offset_u8_p);
-    case io_offset_c_e:
-        return bus_read(self->bus, 0xff00 + get_reg_c(self));
-    case hl_ptr_e:
-        switch (rhs->p.hl_ptr_p) {
-        case hl_ptr_dec_e: {
-            uint16_t hl = get_reg_hl(self);
-            uint8_t res = bus_read(self->bus, hl);
-            set_reg_hl(self, hl - 1);
-            return res;
+uint8_t cpu_fetch_u8(cpu *self) {
+    uint16_t pc = self->pc++;
+    if ((pc >> PAGE_SHIFT) != self->code_page_num || self->code_map_gen != self->bus->map_gen) {
+        self->code_page = self->bus->read_map[pc >> PAGE_SHIFT];
+        self->code_page_num = pc >> PAGE_SHIFT;
+        self->code_map_gen = self->bus->map_gen;
+        /* Executing from OAM, I/O or HRAM, every byte has to go through the bus */
+        if (self->code_page == NULL) {
+            self->code_page_num = PAGE_COUNT;
+            return cpu_read_bus(self, pc);
         }
-        case hl_ptr_inc_e: {
-            uint16_t hl = get_reg_hl(self);
-            uint8_t res = bus_read(self->bus, hl);
-            set_reg_hl(self, hl + 1);
-            return res;
-        }
-        }
-    case register_ptr_e:
-        switch (rhs->p.register_ptr_p) {
-        case bc_register_ptr_e:
-            return bus_read(self->bus, get_reg_bc(self));
-        case de_register_ptr_e:
-            return bus_read(self->bus, get_reg_de(self));
-        case hl_register_ptr_e:
-            return bus_read(self->bus, get_reg_hl(self));
-        }
-    case imm_u8_e:
-        return rhs->p.imm_u8_p;
-    case imm_i8_e:
-        return (int8_t)rhs->p.imm_u8_p;
-    case imm_u16_e:
-        return rhs->p.imm_u16_p;
-    case imm_u16_ptr_e:
-        return bus_read(self->bus, rhs->p.imm_u16_ptr_p);
-    case fixed_payload_e:
-        return rhs->p.fixed_payload_p;
-    case sp_offset_e:
-        return get_reg_sp(self) + rhs->p.sp_offset_p;
     }
+    return self->code_page[pc & (PAGE_SIZE - 1)];
 }
 
-void set_lhs(cpu *self, argument_t *lhs, argument_t *rhs, uint16_t n) {
-    switch (lhs->e) {
-    case none_e:
-        PANIC("Attempted to write to none_e lhs!");
-        break;
-    case condition_e:
-        PANIC("Attempted to write to condition_e lhs!");
-        break;
-    case register_e:
-        switch (lhs->p.register_p) {
-        case a_register_p:
-            set_reg_a(self, (uint8_t)n);
-            break;
-        case f_register_p:
-            set_reg_f(self, (uint8_t)n);
-            break;
-        case b_register_p:
-            set_reg_b(self, (uint8_t)n);
-            break;
-        case c_register_p:
-            set_reg_c(self, (uint8_t)n);
-            break;
-        case d_register_p:
-            set_reg_d(self, (uint8_t)n);
-            break;
-        case e_register_p:
-            set_reg_e(self, (uint8_t)n);
-            break;
-        case h_register_p:
-            set_reg_h(self, (uint8_t)n);
-            break;
-        case l_register_p:
-            set_reg_l(self, (uint8_t)n);
-            break;
-        case af_register_p:
-            set_reg_af(self, n);
-            break;
-        case bc_register_p:
-            set_reg_bc(self, n);
-            break;
-        case de_register_p:
-            set_reg_de(self, n);
-            break;
-        case hl_register_p:
-            set_reg_hl(self, n);
-            break;
-        case sp_register_p:
-            set_reg_sp(self, n);
-            break;
-        }
-        break;
-    case io_offset_u8_e:
-        switch (get_raw_size_argument_t(rhs)) {
-        case 0:
-            PANIC("Attempted to write ZST!");
-            break;
-        case 1:
-            bus_write(self->bus, 0xff00 + lhs->p.io_offset_u8_p, (uint8_t)(n & 0xFF));
-            break;
-        case 2:
-            bus_write(self->bus, 0xff00 + lhs->p.io_offset_u8_p, (uint8_t)(n & 0xFF));
-            bus_write(self->bus, 0xff00 + lhs->p.io_offset_u8_p + 1, (uint8_t)((n >> 8) & 0xFF));
-            break;
-        }
-        break;
-    case io_offset_c_e: {
-        uint8_t c = get_reg_c(self);
-        switch (get_raw_size_argument_t(rhs)) {
-        case 0:
-            PANIC("Attempted to write ZST!");
-            break;
-        case 1:
-            bus_write(self->bus, 0xff00 + c, (uint8_t)(n & 0xFF));
-            break;
-        case 2:
-            bus_write(self->bus, 0xff00 + c, (uint8_t)(n & 0xFF));
-            bus_write(self->bus, 0xff00 + c + 1, (uint8_t)((n >> 8) & 0xFF));
-            break;
-        }
-        break;
-    }
-    case hl_ptr_e: {
-        uint16_t hl = get_reg_hl(self);
-        switch (get_raw_size_argument_t(rhs)) {
-        case 0:
-            PANIC("Attempted to write ZST!");
-            break;
-        case 1:
-            bus_write(self->bus, hl, (uint8_t)n);
-            break;
-        case 2:
-            bus_write(self->bus, hl, (uint8_t)(n & 0xFF));
-            bus_write(self->bus, hl + 1, (uint8_t)((n >> 8) & 0xFF));
-            break;
-        }
-        switch (lhs->p.hl_ptr_p) {
-        case hl_ptr_inc_e:
-            set_reg_hl(self, hl + 1);
-            break;
-        case hl_ptr_dec_e:
-            set_reg_hl(self, hl - 1);
-            break;
-        }
-        break;
-    }
-    case register_ptr_e: {
-        uint16_t addr;
-        switch (lhs->p.register_ptr_p) {
-        case bc_register_ptr_e:
-            addr = get_reg_bc(self);
-            break;
-        case de_register_ptr_e:
-            addr = get_reg_de(self);
-            break;
-        case hl_register_ptr_e:
-            addr = get_reg_hl(self);
-            break;
-        }
-        switch (get_raw_size_argument_t(rhs)) {
-        case 0:
-            PANIC("Attempted to write ZST!");
-            break;
-        case 1:
-            bus_write(self->bus, addr, (uint8_t)n);
-            break;
-        case 2:
-            bus_write(self->bus, addr, (uint8_t)(n & 0xFF));
-            bus_write(self->bus, addr + 1, (uint8_t)((n >> 8) & 0xFF));
-            break;
-        }
-        break;
-    }
-    case imm_u8_e:
-        PANIC("Attempted to write to imm_u8_e lhs!");
-        break;
-    case imm_i8_e:
-        PANIC("Attempted to write to imm_i8_e lhs!");
-        break;
-    case imm_u16_e:
-        PANIC("Attempted to write to imm_u16_e lhs!");
-        break;
-    case imm_u16_ptr_e:
-        switch (get_raw_size_argument_t(rhs)) {
-        case 0:
-            PANIC("Attempted to write ZST!");
-            break;
-        case 1:
-            bus_write(self->bus, lhs->p.imm_u16_ptr_p, (uint8_t)(n & 0xFF));
-            break;
-        case 2:
-            bus_write(self->bus, lhs->p.imm_u16_ptr_p, (uint8_t)(n & 0xFF));
-            bus_write(self->bus, lhs->p.imm_u16_ptr_p + 1, (uint8_t)((n >> 8) & 0xFF));
-            break;
-        }
-        break;
-    case fixed_payload_e:
-        PANIC("Attempted to write to fixed_payload_e lhs!");
-        break;
-    case sp_offset_e:
-        PANIC("Attempted to write to sp_offset_e lhs!");
-        break;
-    }
+/* The two bytes at addr, without advancing pc */
+uint16_t cpu_peek_u16(cpu *self, uint16_t addr) {
+    return cpu_read_bus(self, addr) | (cpu_read_bus(self, addr + 1) << 8);
 }
 
-bool resolve_cond(cpu *self, argument_t *cond) {
-#ifdef TESTING
-    if (cond->e != condition_e)
-        PANIC("Attempted to resolve condition with non-condition payload!");
-#endif
-    switch (cond->p.condition_p) {
-    case none_condition_e:
-        return true;
-    case nzero_condition_e:
-        return get_flag_z(self) == 0;
-    case zero_condition_e:
-        return get_flag_z(self) == 1;
-    case ncarry_condition_e:
-        return get_flag_c(self) == 0;
-    case carry_condition_e:
-        return get_flag_c(self) == 1;
-    }
+uint8_t cpu_get_imm_u8(cpu *self) {
+    return self->imm & 0xFF;
+}
+
+uint16_t cpu_get_imm_u16(cpu *self) {
+    return self->imm;
+}
+
+/* Conditions are resolved to a mask over F and the value the masked bits must have */
+bool cond_taken(cpu *self, const op_t *op) {
+    return op->lhs == 0 || (cpu_get_f(self) & op->lhs) == op->rhs;
 }
 
-void noop(cpu *self, argument_t lhs, argument_t rhs) {
+void noop(cpu *self, const op_t *op) {
     (void)self;
-    (void)lhs;
-    (void)rhs;
+    (void)op;
 }
 
-void ld(cpu *self, argument_t lhs, argument_t rhs) {
-    set_lhs(self, &lhs, &rhs, get_rhs(self, &rhs));
+void illegal(cpu *self, const op_t *op) {
+    (void)self;
+    (void)op;
+    PANIC("Illegal instruction encountered");
 }
 
-void inc(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res = get_rhs(self, &lhs) + 1;
-    (void)rhs;
-    set_lhs(self, &lhs, &lhs, res);
-    switch (lhs.p.register_p) {
-    case bc_register_p:
-    case de_register_p:
-    case hl_register_p:
-    case sp_register_p:
-        break;
-    default:
-        set_flag_z(self, res == 0);
-        set_flag_n(self, 0);
-        set_flag_h_add(self, res - 1, 1);
-        break;
-    }
+void prefix_cb(cpu *self, const op_t *op) {
+    (void)op;
+    op = &CPU_OPS[0x100 | cpu_fetch_u8(self)];
+    op->fn(self, op);
+    self->clocks += op->clocks;
 }
 
-void dec(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res = get_rhs(self, &lhs) - 1;
-    (void)rhs;
-    set_lhs(self, &lhs, &lhs, res);
-    switch (lhs.p.register_p) {
-    case bc_register_p:
-    case de_register_p:
-    case hl_register_p:
-    case sp_register_p:
-        break;
-    default:
-        set_flag_z(self, res == 0);
-        set_flag_n(self, 0);
-        set_flag_h_add(self, res + 1, 1);
-        break;
-    }
+/* 8-bit loads */
+void ld_r_r(cpu *self, const op_t *op) {
+    REG8(self, op->lhs) = REG8(self, op->rhs);
 }
 
-void add(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    res = get_rhs(self, &lhs) + get_rhs(self, &rhs);
-    set_lhs(self, &lhs, &rhs, res);
-    switch (lhs.p.register_p) {
-    case a_register_p:
-        set_flag_z(self, res == 0);
-        break;
-    case sp_register_p:
-        set_flag_z(self, 0);
-        break;
-    default:
-        break;
-    }
-    set_flag_n(self, 0);
-    set_flag_h_add(self, get_rhs(self, &lhs), get_rhs(self, &rhs));
-    set_flag_c_add(self, get_rhs(self, &lhs), get_rhs(self, &rhs));
-}
-
-void adc(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    res = get_rhs(self, &lhs) + get_rhs(self, &rhs) + get_flag_c(self);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 0);
-    set_flag_h_add(self, get_rhs(self, &lhs), get_rhs(self, &rhs) + get_flag_c(self));
-    set_flag_c_add(self, get_rhs(self, &lhs), get_rhs(self, &rhs) + get_flag_c(self));
-}
-
-void sub(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    uint16_t old_rhs = get_rhs(self, &rhs);
-    res = old_lhs - old_rhs;
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 1);
-    /*
-     * TODO:
-     * I don't know if SET_FLAG_{H,C} properly handle subtraction
-     */
-    set_flag_h_add(self, old_lhs, old_rhs);
-    set_flag_c_add(self, old_rhs, old_rhs);
-}
-
-void sbc(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    uint16_t old_rhs = get_rhs(self, &rhs);
-    res = old_lhs - old_rhs - get_flag_c(self);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 1);
-    set_flag_h_add(self, old_lhs, old_rhs - get_flag_c(self));
-    set_flag_c_add(self, old_lhs, old_rhs - get_flag_c(self));
-}
-
-void andReg(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    res = get_rhs(self, &lhs) & get_rhs(self, &rhs);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 0);
-    set_flag_h(self, 1);
-    set_flag_c(self, 0);
-}
-
-void xorReg(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    res = get_rhs(self, &lhs) ^ get_rhs(self, &rhs);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 0);
-    set_flag_h(self, 0);
-    set_flag_c(self, 0);
-}
-
-void orReg(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    res = get_rhs(self, &lhs) | get_rhs(self, &rhs);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 0);
-    set_flag_h(self, 0);
-    set_flag_c(self, 0);
-}
-
-void cp(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    uint16_t old_rhs = get_rhs(self, &rhs);
-    res = old_lhs - old_rhs;
-    set_flag_z(self, res == 0);
-    set_flag_n(self, 1);
-    set_flag_h_add(self, old_lhs, old_rhs);
-    set_flag_c_add(self, old_lhs, old_rhs);
-}
-
-void ret(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)rhs;
-    if (resolve_cond(self, &lhs)) {
-        set_pc(self, get_sp_u16(self));
-    }
+void ld_r_n(cpu *self, const op_t *op) {
+    REG8(self, op->lhs) = cpu_get_imm_u8(self);
 }
 
-void jp(cpu *self, argument_t lhs, argument_t rhs) {
-    if (resolve_cond(self, &lhs)) {
-        set_pc(self, get_rhs(self, &rhs));
-    }
+void ld_r_ind(cpu *self, const op_t *op) {
+    REG8(self, op->lhs) = cpu_read_bus(self, get_reg_rr(self, op->rhs));
 }
 
-void rlc(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs << 1) | (old_lhs >> ((get_raw_size_argument_t(&lhs) << 3) - 1));
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs >> 7);
-}
-
-void rrc(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs >> 1) | (old_lhs << ((get_raw_size_argument_t(&lhs) << 3) - 1));
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs & 0x01);
-}
-
-void rl(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs << 1) | (get_flag_c(self));
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs >> 7);
-}
-
-void rr(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (get_flag_c(self)) | (old_lhs >> 1);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs & 0x01);
-}
-
-void sla(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs << 1);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs >> 7);
-}
-
-void sra(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs & 0x80) | (old_lhs >> 1);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs & 0x01);
-}
-
-void bit(cpu *self, argument_t lhs, argument_t rhs) {
-    if ((get_rhs(self, &rhs) >> get_rhs(self, &lhs)) == 0)
-        set_flag_z(self, true);
-    else
-        set_flag_z(self, false);
-    set_flag_n(self, false);
-    set_flag_h(self, true);
-}
-
-void res(cpu *self, argument_t lhs, argument_t rhs) {
-    set_lhs(self, &lhs, &rhs, get_rhs(self, &rhs) | ~(1 << get_rhs(self, &lhs)));
-}
-
-void set(cpu *self, argument_t lhs, argument_t rhs) {
-    set_lhs(self, &lhs, &rhs, get_rhs(self, &rhs) | (1 << get_rhs(self, &lhs)));
-}
-
-void swap(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    (void)rhs;
-    res = (get_rhs(self, &lhs) & 0x0F) | (get_rhs(self, &lhs) >> 4);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, false);
-}
-
-void srl(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t res;
-    uint16_t old_lhs = get_rhs(self, &lhs);
-    (void)rhs;
-    res = (old_lhs >> 1);
-    set_lhs(self, &lhs, &rhs, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, old_lhs & 0x01);
-}
-
-void jr(cpu *self, argument_t lhs, argument_t rhs) {
-    if (resolve_cond(self, &lhs)) {
-        self->clocks++;
-        set_pc(self, get_pc(self) + get_rhs(self, &rhs));
-    }
+void ld_ind_r(cpu *self, const op_t *op) {
+    cpu_write_bus(self, get_reg_rr(self, op->lhs), REG8(self, op->rhs));
 }
 
-void push(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)rhs;
-    set_sp_u16(self, get_rhs(self, &lhs));
+void ld_hl_n(cpu *self, const op_t *op) {
+    (void)op;
+    cpu_write_bus(self, get_reg_hl(self), cpu_get_imm_u8(self));
 }
 
-void pop(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)rhs;
-    set_lhs(self, &lhs, &rhs, get_sp_u16(self));
+void ld_hli_a(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    cpu_write_bus(self, hl, get_reg_a(self));
+    set_reg_hl(self, hl + 1);
 }
 
-void rla(cpu *self, argument_t lhs, argument_t rhs) {
-    uint8_t res;
-    uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    res = (a << 1) | get_flag_c(self);
-    set_reg_a(self, res);
-    set_flag_z(self, res == 0x0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, a >> 7);
+void ld_hld_a(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    cpu_write_bus(self, hl, get_reg_a(self));
+    set_reg_hl(self, hl - 1);
 }
 
-void di(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)self;
-    (void)lhs;
-    (void)rhs;
-    UNIMPLEMENTED("di");
+void ld_a_hli(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    set_reg_a(self, cpu_read_bus(self, hl));
+    set_reg_hl(self, hl + 1);
 }
 
-void ei(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)self;
-    (void)lhs;
-    (void)rhs;
-    UNIMPLEMENTED("ei");
+void ld_a_hld(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    set_reg_a(self, cpu_read_bus(self, hl));
+    set_reg_hl(self, hl - 1);
 }
 
-void halt(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)lhs;
-    (void)rhs;
-    self->mode = cpu_halted_mode_e;
+void ld_a_nn(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_a(self, cpu_read_bus(self, cpu_get_imm_u16(self)));
 }
 
-void reti(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)self;
-    (void)lhs;
-    (void)rhs;
-    UNIMPLEMENTED("reti");
+void ld_nn_a(cpu *self, const op_t *op) {
+    (void)op;
+    cpu_write_bus(self, cpu_get_imm_u16(self), get_reg_a(self));
+}
+
+void ldh_a_n(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_a(self, cpu_read_bus(self, 0xff00 + cpu_get_imm_u8(self)));
+}
+
+void ldh_n_a(cpu *self, const op_t *op) {
+    (void)op;
+    cpu_write_bus(self, 0xff00 + cpu_get_imm_u8(self), get_reg_a(self));
+}
+
+void ldh_a_c(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_a(self, cpu_read_bus(self, 0xff00 + get_reg_c(self)));
+}
+
+void ldh_c_a(cpu *self, const op_t *op) {
+    (void)op;
+    cpu_write_bus(self, 0xff00 + get_reg_c(self), get_reg_a(self));
+}
+
+/* 16-bit loads */
+void ld_rr_nn(cpu *self, const op_t *op) {
+    set_reg_rr(self, op->lhs, cpu_get_imm_u16(self));
 }
 
-void rlca(cpu *self, argument_t lhs, argument_t rhs) {
-    uint8_t res;
+void ld_sp_nn(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_sp(self, cpu_get_imm_u16(self));
+}
+
+void ld_nn_sp(cpu *self, const op_t *op) {
+    uint16_t addr = cpu_get_imm_u16(self);
+    (void)op;
+    cpu_write_bus(self, addr, get_reg_sp(self) & 0xFF);
+    cpu_write_bus(self, addr + 1, (get_reg_sp(self) >> 8) & 0xFF);
+}
+
+void ld_sp_hl(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_sp(self, get_reg_hl(self));
+}
+
+/* sp + e, flags are the carries of adding e to the low byte of sp */
+uint16_t add_sp_u8(cpu *self, uint8_t e) {
+    uint16_t sp = get_reg_sp(self);
+    uint16_t res = sp + (int8_t)e;
+    uint16_t carries = sp ^ (int8_t)e ^ res;
+    cpu_set_f(self, ((carries & 0x10) << 1) | ((carries >> 4) & FLAG_C));
+    return res;
+}
+
+void ld_hl_sp_e(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_hl(self, add_sp_u8(self, cpu_get_imm_u8(self)));
+}
+
+void push(cpu *self, const op_t *op) {
+    set_sp_u16(self, get_reg_rr(self, op->lhs));
+}
+
+void pop(cpu *self, const op_t *op) {
+    set_reg_rr(self, op->lhs, get_sp_u16(self));
+}
+
+void push_af(cpu *self, const op_t *op) {
+    (void)op;
+    set_sp_u16(self, get_reg_af(self));
+}
+
+void pop_af(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_af(self, get_sp_u16(self));
+}
+
+/* 8-bit arithmetic, shared by the register, (hl) and immediate forms */
+uint8_t add_u8(cpu *self, uint8_t n, uint8_t carry) {
     uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    res = (a << 1) | (a >> 7);
-    set_reg_a(self, res);
-    set_flag_z(self, res == 0x0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, res & 0x1);
+    uint16_t res = a + n + carry;
+    set_flags_lazy(self, flags_add_e, a, n, res);
+    return res;
 }
 
-void rra(cpu *self, argument_t lhs, argument_t rhs) {
-    uint8_t res;
+uint8_t sub_u8(cpu *self, uint8_t n, uint8_t carry) {
     uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    res = (get_flag_c(self) << 7) | (a >> 1);
+    uint16_t res = a - n - carry;
+    set_flags_lazy(self, flags_sub_e, a, n, res);
+    return res;
+}
+
+void add_a(cpu *self, uint8_t n) {
+    set_reg_a(self, add_u8(self, n, 0));
+}
+
+void adc_a(cpu *self, uint8_t n) {
+    set_reg_a(self, add_u8(self, n, get_flag_c(self)));
+}
+
+void sub_a(cpu *self, uint8_t n) {
+    set_reg_a(self, sub_u8(self, n, 0));
+}
+
+void sbc_a(cpu *self, uint8_t n) {
+    set_reg_a(self, sub_u8(self, n, get_flag_c(self)));
+}
+
+void and_a(cpu *self, uint8_t n) {
+    uint8_t res = get_reg_a(self) & n;
     set_reg_a(self, res);
-    set_flag_z(self, res == 0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, a & 0x1);
+    set_flags_zero(self, res, FLAG_H);
 }
 
-void rrca(cpu *self, argument_t lhs, argument_t rhs) {
-    uint8_t res;
-    uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    res = (a & 0x1 << 7) | (a >> 1);
+void xor_a(cpu *self, uint8_t n) {
+    uint8_t res = get_reg_a(self) ^ n;
     set_reg_a(self, res);
-    set_flag_z(self, res == 0x0);
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, a & 0x1);
+    set_flags_zero(self, res, 0);
 }
 
-void rst(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)self;
-    (void)lhs;
-    (void)rhs;
-    UNIMPLEMENTED("rst");
+void or_a(cpu *self, uint8_t n) {
+    uint8_t res = get_reg_a(self) | n;
+    set_reg_a(self, res);
+    set_flags_zero(self, res, 0);
 }
 
-void call(cpu *self, argument_t lhs, argument_t rhs) {
-    uint16_t pc = get_pc(self);
-    if (resolve_cond(self, &lhs)) {
-        set_sp_u16(self, pc);
-        set_pc(self, get_rhs(self, &rhs));
-        self->clocks += 3;
+void cp_a(cpu *self, uint8_t n) {
+    sub_u8(self, n, 0);
+}
+
+/* clang-format off */
+#define ALU_HANDLERS(name)                                                                         \
+    void name##_r(cpu *self, const op_t *op) {                                                     \
+        name(self, REG8(self, op->rhs));                                                           \
+    }                                                                                              \
+    void name##_hl(cpu *self, const op_t *op) {                                                    \
+        (void)op;                                                                                  \
+        name(self, cpu_read_bus(self, get_reg_hl(self)));                                          \
+    }                                                                                              \
+    void name##_n(cpu *self, const op_t *op) {                                                     \
+        (void)op;                                                                                  \
+        name(self, cpu_get_imm_u8(self));                                                          \
     }
+/* clang-format on */
+
+ALU_HANDLERS(add_a)
+ALU_HANDLERS(adc_a)
+ALU_HANDLERS(sub_a)
+ALU_HANDLERS(sbc_a)
+ALU_HANDLERS(and_a)
+ALU_HANDLERS(xor_a)
+ALU_HANDLERS(or_a)
+ALU_HANDLERS(cp_a)
+
+/* Both leave C alone */
+uint8_t inc_u8(cpu *self, uint8_t n) {
+    uint8_t res = n + 1;
+    uint8_t h = (res & 0x0F) == 0x00 ? FLAG_H : 0;
+    set_flags_zero(self, res, h | get_flag_c(self) << 4);
+    return res;
+}
+
+uint8_t dec_u8(cpu *self, uint8_t n) {
+    uint8_t res = n - 1;
+    uint8_t h = (res & 0x0F) == 0x0F ? FLAG_H : 0;
+    set_flags_zero(self, res, FLAG_N | h | get_flag_c(self) << 4);
+    return res;
+}
+
+void inc_r(cpu *self, const op_t *op) {
+    REG8(self, op->lhs) = inc_u8(self, REG8(self, op->lhs));
+}
+
+void dec_r(cpu *self, const op_t *op) {
+    REG8(self, op->lhs) = dec_u8(self, REG8(self, op->lhs));
+}
+
+void inc_hl(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    cpu_write_bus(self, hl, inc_u8(self, cpu_read_bus(self, hl)));
+}
+
+void dec_hl(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    (void)op;
+    cpu_write_bus(self, hl, dec_u8(self, cpu_read_bus(self, hl)));
+}
+
+/* 16-bit arithmetic */
+void inc_rr(cpu *self, const op_t *op) {
+    set_reg_rr(self, op->lhs, get_reg_rr(self, op->lhs) + 1);
+}
+
+void dec_rr(cpu *self, const op_t *op) {
+    set_reg_rr(self, op->lhs, get_reg_rr(self, op->lhs) - 1);
+}
+
+void inc_sp(cpu *self, const op_t *op) {
+    (void)op;
+    self->sp++;
+}
+
+void dec_sp(cpu *self, const op_t *op) {
+    (void)op;
+    self->sp--;
+}
+
+void add_hl_u16(cpu *self, uint16_t n) {
+    uint16_t hl = get_reg_hl(self);
+    uint32_t res = hl + n;
+    /* Carries out of bits 11 and 15, Z is left alone */
+    uint8_t h = ((hl ^ n ^ res) & 0x1000) ? FLAG_H : 0;
+    uint8_t c = (res & 0x10000) ? FLAG_C : 0;
+    set_reg_hl(self, res);
+    cpu_set_f(self, (cpu_get_f(self) & FLAG_Z) | h | c);
+}
+
+void add_hl_rr(cpu *self, const op_t *op) {
+    add_hl_u16(self, get_reg_rr(self, op->rhs));
+}
+
+void add_hl_sp(cpu *self, const op_t *op) {
+    (void)op;
+    add_hl_u16(self, get_reg_sp(self));
+}
+
+void add_sp_e(cpu *self, const op_t *op) {
+    (void)op;
+    set_reg_sp(self, add_sp_u8(self, cpu_get_imm_u8(self)));
+}
+
+/* Rotates, shifts and bit operations */
+uint8_t rlc_u8(cpu *self, uint8_t n) {
+    uint8_t res = (n << 1) | (n >> 7);
+    set_flags_zero(self, res, (n >> 7) << 4);
+    return res;
+}
+
+uint8_t rrc_u8(cpu *self, uint8_t n) {
+    uint8_t res = (n >> 1) | (n << 7);
+    set_flags_zero(self, res, (n & 0x01) << 4);
+    return res;
+}
+
+uint8_t rl_u8(cpu *self, uint8_t n) {
+    uint8_t res = (n << 1) | get_flag_c(self);
+    set_flags_zero(self, res, (n >> 7) << 4);
+    return res;
+}
+
+uint8_t rr_u8(cpu *self, uint8_t n) {
+    uint8_t res = (get_flag_c(self) << 7) | (n >> 1);
+    set_flags_zero(self, res, (n & 0x01) << 4);
+    return res;
+}
+
+uint8_t sla_u8(cpu *self, uint8_t n) {
+    uint8_t res = n << 1;
+    set_flags_zero(self, res, (n >> 7) << 4);
+    return res;
+}
+
+uint8_t sra_u8(cpu *self, uint8_t n) {
+    uint8_t res = (n & 0x80) | (n >> 1);
+    set_flags_zero(self, res, (n & 0x01) << 4);
+    return res;
+}
+
+uint8_t swap_u8(cpu *self, uint8_t n) {
+    uint8_t res = (n << 4) | (n >> 4);
+    set_flags_zero(self, res, 0);
+    return res;
+}
+
+uint8_t srl_u8(cpu *self, uint8_t n) {
+    uint8_t res = n >> 1;
+    set_flags_zero(self, res, (n & 0x01) << 4);
+    return res;
+}
+
+/* clang-format off */
+#define CB_HANDLERS(name)                                                                          \
+    void name##_r(cpu *self, const op_t *op) {                                                     \
+        REG8(self, op->lhs) = name(self, REG8(self, op->lhs));                                     \
+    }                                                                                              \
+    void name##_hl(cpu *self, const op_t *op) {                                                    \
+        uint16_t hl = get_reg_hl(self);                                                            \
+        (void)op;                                                                                  \
+        cpu_write_bus(self, hl, name(self, cpu_read_bus(self, hl)));                               \
+    }
+/* clang-format on */
+
+CB_HANDLERS(rlc_u8)
+CB_HANDLERS(rrc_u8)
+CB_HANDLERS(rl_u8)
+CB_HANDLERS(rr_u8)
+CB_HANDLERS(sla_u8)
+CB_HANDLERS(sra_u8)
+CB_HANDLERS(swap_u8)
+CB_HANDLERS(srl_u8)
+
+void bit_u8(cpu *self, uint8_t bit, uint8_t n) {
+    set_flags_zero(self, n & (1 << bit), FLAG_H | get_flag_c(self) << 4);
+}
+
+void bit_r(cpu *self, const op_t *op) {
+    bit_u8(self, op->lhs, REG8(self, op->rhs));
 }
 
-void ccf(cpu *self, argument_t lhs, argument_t rhs) {
-    uint8_t c = get_flag_c(self);
-    (void)lhs;
-    (void)rhs;
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, (~c) & 0x1);
+void bit_hl(cpu *self, const op_t *op) {
+    bit_u8(self, op->lhs, cpu_read_bus(self, get_reg_hl(self)));
 }
 
-void cpl(cpu *self, argument_t lhs, argument_t rhs) {
+void res_r(cpu *self, const op_t *op) {
+    REG8(self, op->rhs) &= ~(1 << op->lhs);
+}
+
+void res_hl(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    cpu_write_bus(self, hl, cpu_read_bus(self, hl) & ~(1 << op->lhs));
+}
+
+void set_r(cpu *self, const op_t *op) {
+    REG8(self, op->rhs) |= 1 << op->lhs;
+}
+
+void set_hl(cpu *self, const op_t *op) {
+    uint16_t hl = get_reg_hl(self);
+    cpu_write_bus(self, hl, cpu_read_bus(self, hl) | (1 << op->lhs));
+}
+
+/* The accumulator rotates always clear Z, unlike their CB counterparts */
+void rla(cpu *self, const op_t *op) {
     uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    set_reg_a(self, ~a);
-    set_flag_n(self, true);
-    set_flag_h(self, true);
+    (void)op;
+    set_reg_a(self, (a << 1) | get_flag_c(self));
+    cpu_set_f(self, (a >> 7) << 4);
+}
+
+void rlca(cpu *self, const op_t *op) {
+    uint8_t a = get_reg_a(self);
+    (void)op;
+    set_reg_a(self, (a << 1) | (a >> 7));
+    cpu_set_f(self, (a >> 7) << 4);
+}
+
+void rra(cpu *self, const op_t *op) {
+    uint8_t a = get_reg_a(self);
+    (void)op;
+    set_reg_a(self, (get_flag_c(self) << 7) | (a >> 1));
+    cpu_set_f(self, (a & 0x01) << 4);
 }
 
-void stop(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)lhs;
-    (void)rhs;
+void rrca(cpu *self, const op_t *op) {
+    uint8_t a = get_reg_a(self);
+    (void)op;
+    set_reg_a(self, (a << 7) | (a >> 1));
+    cpu_set_f(self, (a & 0x01) << 4);
+}
+
+/*
+ * Control flow. Conditional branches are listed with the clocks they take when not taken, the
+ * handlers add the rest. JR is listed with its untaken cost even without a condition.
+ */
+void jp(cpu *self, const op_t *op) {
+    uint16_t addr = cpu_get_imm_u16(self);
+    if (cond_taken(self, op)) {
+        set_pc(self, addr);
+        if (op->lhs != 0)
+            self->clocks++;
+    }
+}
+
+void jp_hl(cpu *self, const op_t *op) {
+    (void)op;
+    set_pc(self, get_reg_hl(self));
+}
+
+void jr(cpu *self, const op_t *op) {
+    int8_t offset = cpu_get_imm_u8(self);
+    if (cond_taken(self, op)) {
+        self->clocks++;
+        set_pc(self, get_pc(self) + offset);
+    }
+}
+
+void call(cpu *self, const op_t *op) {
+    uint16_t addr = cpu_get_imm_u16(self);
+    if (cond_taken(self, op)) {
+        set_sp_u16(self, get_pc(self));
+        set_pc(self, addr);
+        if (op->lhs != 0)
+            self->clocks += 3;
+    }
+}
+
+void ret(cpu *self, const op_t *op) {
+    if (cond_taken(self, op)) {
+        set_pc(self, get_sp_u16(self));
+        if (op->lhs != 0)
+            self->clocks += 3;
+    }
+}
+
+void reti(cpu *self, const op_t *op) {
+    (void)op;
+    set_pc(self, get_sp_u16(self));
+    self->ime = true;
+}
+
+void rst(cpu *self, const op_t *op) {
+    set_sp_u16(self, get_pc(self));
+    set_pc(self, op->lhs);
+}
+
+/* Misc */
+void di(cpu *self, const op_t *op) {
+    (void)op;
+    self->ime = false;
+}
+
+void ei(cpu *self, const op_t *op) {
+    (void)op;
+    self->ime = true;
+    self->ei_delay = true;
+}
+
+void halt(cpu *self, const op_t *op) {
+    (void)op;
+    self->mode = cpu_halted_mode_e;
+}
+
+void stop(cpu *self, const op_t *op) {
+    (void)op;
     self->mode = cpu_stop_mode_e;
 }
 
+void ccf(cpu *self, const op_t *op) {
+    uint8_t f = cpu_get_f(self);
+    (void)op;
+    cpu_set_f(self, (f & FLAG_Z) | ((f ^ FLAG_C) & FLAG_C));
+}
+
+void cpl(cpu *self, const op_t *op) {
+    uint8_t a = get_reg_a(self);
+    (void)op;
+    set_reg_a(self, ~a);
+    cpu_set_f(self, cpu_get_f(self) | FLAG_N | FLAG_H);
+}
+
 /* https://forums.nesdev.org/viewtopic.php?t=15944 */
-void daa(cpu *self, argument_t lhs, argument_t rhs) {
+void daa(cpu *self, const op_t *op) {
     uint8_t a = get_reg_a(self);
-    (void)lhs;
-    (void)rhs;
-    if (!get_flag_n(self)) {
-        if (get_flag_c(self) || a > 0x99) {
-            set_reg_a(self, a + 0x60);
-            set_flag_c(self, true);
-        }
-        if (get_flag_h(self) || (a & 0x0f) > 0x09) {
-            set_reg_a(self, a + 0x06);
+    uint8_t f = cpu_get_f(self);
+    (void)op;
+    if (!(f & FLAG_N)) {
+        if ((f & FLAG_C) || a > 0x99) {
+            a += 0x60;
+            f |= FLAG_C;
         }
+        if ((f & FLAG_H) || (a & 0x0f) > 0x09)
+            a += 0x06;
     } else {
-        if (get_flag_c(self))
-            set_reg_a(self, a - 0x60);
-        if (get_flag_h(self))
-            set_reg_a(self, a - 0x06);
+        if (f & FLAG_C)
+            a -= 0x60;
+        if (f & FLAG_H)
+            a -= 0x06;
     }
-    set_flag_z(self, get_reg_a(self) == 0x00);
-    set_flag_h(self, false);
+    set_reg_a(self, a);
+    cpu_set_f(self, (f & (FLAG_N | FLAG_C)) | (a == 0x00 ? FLAG_Z : 0));
 }
 
-void scf(cpu *self, argument_t lhs, argument_t rhs) {
-    (void)lhs;
-    (void)rhs;
-    set_flag_n(self, false);
-    set_flag_h(self, false);
-    set_flag_c(self, true);
+void scf(cpu *self, const op_t *op) {
+    (void)op;
+    cpu_set_f(self, (cpu_get_f(self) & FLAG_Z) | FLAG_C);
 }
 
-uintptr_t cpu_clock(cpu *self) {
-    instruction_t instr;
-    uintptr_t old_clocks;
-    if (self->mode != cpu_running_mode_e)
+/* Operand resolution, run once per opcode when the table is built */
+uint8_t resolve_reg8(argument_t *arg) {
+    switch (arg->p.register_p) {
+    case a_register_p:
+        return REG_A;
+    case f_register_p:
+        return REG_F;
+    case b_register_p:
+        return REG_B;
+    case c_register_p:
+        return REG_C;
+    case d_register_p:
+        return REG_D;
+    case e_register_p:
+        return REG_E;
+    case h_register_p:
+        return REG_H;
+    case l_register_p:
+        return REG_L;
+    default:
+        PANIC("Attempted to resolve 16-bit register as 8-bit!");
         return 0;
-    LOG("CPU", "Clocks %#lu", self->clocks);
-    /* LOG("CPU", "Reading address %#04x", self->pc); */
-    old_clocks = self->clocks;
-    if (self->sp == 0x100) {
-        PANIC("finished boot");
     }
-    instr = decoder_next(&self->decoder);
+}
 
-    {
-        char *instr_str = print_instruction(&instr);
-        LOG("CPU", "%s", instr_str);
-        free(instr_str);
+/* Only BC, DE and HL live in regs, callers pick separate handlers for AF and SP */
+uint8_t resolve_reg16(argument_t *arg) {
+    if (arg->e == register_ptr_e) {
+        switch (arg->p.register_ptr_p) {
+        case bc_register_ptr_e:
+            return REG_BC;
+        case de_register_ptr_e:
+            return REG_DE;
+        case hl_register_ptr_e:
+            return REG_HL;
+        }
     }
-    switch (instr.instruction_type) {
-    case adc_instruction:
-        adc(self, instr.lhs, instr.rhs);
+    switch (arg->p.register_p) {
+    case bc_register_p:
+        return REG_BC;
+    case de_register_p:
+        return REG_DE;
+    case hl_register_p:
+        return REG_HL;
+    default:
+        PANIC("Attempted to resolve 8-bit register as 16-bit!");
+        return 0;
+    }
+}
+
+bool is_reg8(argument_t *arg) {
+    return arg->e == register_e && get_raw_size_argument_t(arg) == 1;
+}
+
+bool is_sp(argument_t *arg) {
+    return arg->e == register_e && arg->p.register_p == sp_register_p;
+}
+
+bool is_af(argument_t *arg) {
+    return arg->e == register_e && arg->p.register_p == af_register_p;
+}
+
+bool is_hl_ptr(argument_t *arg) {
+    return arg->e == register_ptr_e && arg->p.register_ptr_p == hl_register_ptr_e;
+}
+
+void resolve_cond(op_t *op, argument_t *cond) {
+    switch (cond->p.condition_p) {
+    case none_condition_e:
+        op->lhs = 0;
+        op->rhs = 0;
         break;
-    case add_instruction:
-        add(self, instr.lhs, instr.rhs);
+    case nzero_condition_e:
+        op->lhs = FLAG_Z;
+        op->rhs = 0;
         break;
-    case and_instruction:
-        andReg(self, instr.lhs, instr.rhs);
+    case zero_condition_e:
+        op->lhs = FLAG_Z;
+        op->rhs = FLAG_Z;
         break;
-    case bit_instruction:
-        bit(self, instr.lhs, instr.rhs);
+    case ncarry_condition_e:
+        op->lhs = FLAG_C;
+        op->rhs = 0;
         break;
-    case call_instruction:
-        call(self, instr.lhs, instr.rhs);
+    case carry_condition_e:
+        op->lhs = FLAG_C;
+        op->rhs = FLAG_C;
         break;
-    case ccf_instruction:
-        ccf(self, instr.lhs, instr.rhs);
+    }
+}
+
+/* Picks the register, (hl) or immediate flavour of an 8-bit source operand */
+op_handler resolve_src8(op_t *op, argument_t *src, op_handler r, op_handler hl, op_handler n) {
+    if (is_reg8(src)) {
+        op->rhs = resolve_reg8(src);
+        return r;
+    }
+    return is_hl_ptr(src) ? hl : n;
+}
+
+op_handler resolve_ld(op_t *op, argument_t *lhs, argument_t *rhs) {
+    if (is_reg8(lhs)) {
+        op->lhs = resolve_reg8(lhs);
+        switch (rhs->e) {
+        case register_e:
+            op->rhs = resolve_reg8(rhs);
+            return ld_r_r;
+        case imm_u8_e:
+            return ld_r_n;
+        case register_ptr_e:
+            op->rhs = resolve_reg16(rhs);
+            return ld_r_ind;
+        case hl_ptr_e:
+            return rhs->p.hl_ptr_p == hl_ptr_inc_e ? ld_a_hli : ld_a_hld;
+        case imm_u16_ptr_e:
+            return ld_a_nn;
+        case io_offset_u8_e:
+            return ldh_a_n;
+        case io_offset_c_e:
+            return ldh_a_c;
+        default:
+            break;
+        }
+    } else if (lhs->e == register_e) {
+        switch (rhs->e) {
+        case imm_u16_e:
+            if (is_sp(lhs))
+                return ld_sp_nn;
+            op->lhs = resolve_reg16(lhs);
+            return ld_rr_nn;
+        case register_e:
+            return ld_sp_hl;
+        case sp_offset_e:
+            return ld_hl_sp_e;
+        default:
+            break;
+        }
+    } else {
+        switch (lhs->e) {
+        case register_ptr_e:
+            op->lhs = resolve_reg16(lhs);
+            if (rhs->e == imm_u8_e)
+                return ld_hl_n;
+            op->rhs = resolve_reg8(rhs);
+            return ld_ind_r;
+        case hl_ptr_e:
+            return lhs->p.hl_ptr_p == hl_ptr_inc_e ? ld_hli_a : ld_hld_a;
+        case imm_u16_ptr_e:
+            return is_reg8(rhs) ? ld_nn_a : ld_nn_sp;
+        case io_offset_u8_e:
+            return ldh_n_a;
+        case io_offset_c_e:
+            return ldh_c_a;
+        default:
+            break;
+        }
+    }
+    PANIC("Unresolvable ld operands");
+    return illegal;
+}
+
+op_t resolve_op(const instruction_t *instr) {
+    argument_t lhs = instr->lhs;
+    argument_t rhs = instr->rhs;
+    op_t op;
+    op.lhs = 0;
+    op.rhs = 0;
+    op.clocks = instr->clocks;
+    op.length = instr->length;
+
+    switch (instr->instruction_type) {
+    case adc_instruction:
+        op.fn = resolve_src8(&op, &rhs, adc_a_r, adc_a_hl, adc_a_n);
         break;
-    case cp_instruction:
-        cp(self, instr.lhs, instr.rhs);
+    case add_instruction:
+        if (is_reg8(&lhs)) {
+            op.fn = resolve_src8(&op, &rhs, add_a_r, add_a_hl, add_a_n);
+        } else if (lhs.p.register_p == sp_register_p) {
+            op.fn = add_sp_e;
+        } else if (is_sp(&rhs)) {
+            op.fn = add_hl_sp;
+        } else {
+            op.rhs = resolve_reg16(&rhs);
+            op.fn = add_hl_rr;
+        }
         break;
-    case cpl_instruction:
-        cpl(self, instr.lhs, instr.rhs);
+    case and_instruction:
+        op.fn = resolve_src8(&op, &rhs, and_a_r, and_a_hl, and_a_n);
         break;
-    case daa_instruction:
-        daa(self, instr.lhs, instr.rhs);
+    case cp_instruction:
+        op.fn = resolve_src8(&op, &rhs, cp_a_r, cp_a_hl, cp_a_n);
         break;
-    case dec_instruction:
-        dec(self, instr.lhs, instr.rhs);
+    case or_instruction:
+        op.fn = resolve_src8(&op, &rhs, or_a_r, or_a_hl, or_a_n);
         break;
-    case di_instruction:
-        di(self, instr.lhs, instr.rhs);
+    case sbc_instruction:
+        op.fn = resolve_src8(&op, &rhs, sbc_a_r, sbc_a_hl, sbc_a_n);
         break;
-    case ei_instruction:
-        ei(self, instr.lhs, instr.rhs);
+    case sub_instruction:
+        op.fn = resolve_src8(&op, &rhs, sub_a_r, sub_a_hl, sub_a_n);
         break;
-    case halt_instruction:
-        halt(self, instr.lhs, instr.rhs);
+    case xor_instruction:
+        op.fn = resolve_src8(&op, &rhs, xor_a_r, xor_a_hl, xor_a_n);
         break;
     case inc_instruction:
-        inc(self, instr.lhs, instr.rhs);
-        break;
-    case jp_instruction:
-        jp(self, instr.lhs, instr.rhs);
-        break;
-    case jr_instruction:
-        jr(self, instr.lhs, instr.rhs);
+    case dec_instruction: {
+        bool inc = instr->instruction_type == inc_instruction;
+        if (is_reg8(&lhs)) {
+            op.lhs = resolve_reg8(&lhs);
+            op.fn = inc ? inc_r : dec_r;
+        } else if (is_hl_ptr(&lhs)) {
+            op.fn = inc ? inc_hl : dec_hl;
+        } else if (is_sp(&lhs)) {
+            op.fn = inc ? inc_sp : dec_sp;
+        } else {
+            op.lhs = resolve_reg16(&lhs);
+            op.fn = inc ? inc_rr : dec_rr;
+        }
         break;
+    }
     case ld_instruction:
-        ld(self, instr.lhs, instr.rhs);
-        break;
-    case noop_instruction:
-        noop(self, instr.lhs, instr.rhs);
-        break;
-    case or_instruction:
-        orReg(self, instr.lhs, instr.rhs);
-        break;
-    case pop_instruction:
-        pop(self, instr.lhs, instr.rhs);
+        op.fn = resolve_ld(&op, &lhs, &rhs);
         break;
     case push_instruction:
-        push(self, instr.lhs, instr.rhs);
+    case pop_instruction: {
+        bool push_op = instr->instruction_type == push_instruction;
+        if (is_af(&lhs)) {
+            op.fn = push_op ? push_af : pop_af;
+        } else {
+            op.lhs = resolve_reg16(&lhs);
+            op.fn = push_op ? push : pop;
+        }
         break;
+    }
+    case bit_instruction:
     case res_instruction:
-        res(self, instr.lhs, instr.rhs);
-        break;
-    case ret_instruction:
-        ret(self, instr.lhs, instr.rhs);
-        break;
-    case reti_instruction:
-        reti(self, instr.lhs, instr.rhs);
+    case set_instruction:
+        op.lhs = lhs.p.fixed_payload_p;
+        if (instr->instruction_type == bit_instruction)
+            op.fn = resolve_src8(&op, &rhs, bit_r, bit_hl, illegal);
+        else if (instr->instruction_type == res_instruction)
+            op.fn = resolve_src8(&op, &rhs, res_r, res_hl, illegal);
+        else
+            op.fn = resolve_src8(&op, &rhs, set_r, set_hl, illegal);
         break;
+    case rlc_instruction:
+    case rrc_instruction:
     case rl_instruction:
-        rl(self, instr.lhs, instr.rhs);
+    case rr_instruction:
+    case sla_instruction:
+    case sra_instruction:
+    case swap_instruction:
+    case srl_instruction: {
+        op_handler r;
+        op_handler hl;
+        switch (instr->instruction_type) {
+        case rlc_instruction:
+            r = rlc_u8_r;
+            hl = rlc_u8_hl;
+            break;
+        case rrc_instruction:
+            r = rrc_u8_r;
+            hl = rrc_u8_hl;
+            break;
+        case rl_instruction:
+            r = rl_u8_r;
+            hl = rl_u8_hl;
+            break;
+        case rr_instruction:
+            r = rr_u8_r;
+            hl = rr_u8_hl;
+            break;
+        case sla_instruction:
+            r = sla_u8_r;
+            hl = sla_u8_hl;
+            break;
+        case sra_instruction:
+            r = sra_u8_r;
+            hl = sra_u8_hl;
+            break;
+        case swap_instruction:
+            r = swap_u8_r;
+            hl = swap_u8_hl;
+            break;
+        default:
+            r = srl_u8_r;
+            hl = srl_u8_hl;
+            break;
+        }
+        if (is_hl_ptr(&lhs)) {
+            op.fn = hl;
+        } else {
+            op.lhs = resolve_reg8(&lhs);
+            op.fn = r;
+        }
         break;
-    case rla_instruction:
-        rla(self, instr.lhs, instr.rhs);
+    }
+    case jp_instruction:
+        resolve_cond(&op, &lhs);
+        op.fn = rhs.e == register_e ? jp_hl : jp;
         break;
-    case rlca_instruction:
-        rlca(self, instr.lhs, instr.rhs);
+    case jr_instruction:
+        resolve_cond(&op, &lhs);
+        op.fn = jr;
         break;
-    case rlc_instruction:
-        rlc(self, instr.lhs, instr.rhs);
+    case call_instruction:
+        resolve_cond(&op, &lhs);
+        op.fn = call;
         break;
-    case rr_instruction:
-        rr(self, instr.lhs, instr.rhs);
+    case ret_instruction:
+        resolve_cond(&op, &lhs);
+        op.fn = ret;
         break;
-    case rra_instruction:
-        rra(self, instr.lhs, instr.rhs);
+    case reti_instruction:
+        op.fn = reti;
         break;
-    case rrca_instruction:
-        rrca(self, instr.lhs, instr.rhs);
+    case rst_instruction:
+        op.lhs = lhs.p.fixed_payload_p;
+        op.fn = rst;
         break;
-    case rrc_instruction:
-        rrc(self, instr.lhs, instr.rhs);
+    case ccf_instruction:
+        op.fn = ccf;
         break;
-    case rst_instruction:
-        rst(self, instr.lhs, instr.rhs);
+    case cpl_instruction:
+        op.fn = cpl;
         break;
-    case sbc_instruction:
-        sbc(self, instr.lhs, instr.rhs);
+    case daa_instruction:
+        op.fn = daa;
         break;
-    case scf_instruction:
-        scf(self, instr.lhs, instr.rhs);
+    case di_instruction:
+        op.fn = di;
         break;
-    case set_instruction:
-        set(self, instr.lhs, instr.rhs);
+    case ei_instruction:
+        op.fn = ei;
         break;
-    case sla_instruction:
-        sla(self, instr.lhs, instr.rhs);
+    case halt_instruction:
+        op.fn = halt;
         break;
-    case sra_instruction:
-        sra(self, instr.lhs, instr.rhs);
+    case noop_instruction:
+        op.fn = noop;
         break;
-    case srl_instruction:
-        srl(self, instr.lhs, instr.rhs);
+    case rla_instruction:
+        op.fn = rla;
         break;
-    case stop_instruction:
-        stop(self, instr.lhs, instr.rhs);
+    case rlca_instruction:
+        op.fn = rlca;
         break;
-    case sub_instruction:
-        sub(self, instr.lhs, instr.rhs);
+    case rra_instruction:
+        op.fn = rra;
         break;
-    case swap_instruction:
-        swap(self, instr.lhs, instr.rhs);
+    case rrca_instruction:
+        op.fn = rrca;
         break;
-    case xor_instruction:
-        xorReg(self, instr.lhs, instr.rhs);
+    case scf_instruction:
+        op.fn = scf;
+        break;
+    case stop_instruction:
+        op.fn = stop;
         break;
     case illegal_instruction:
-        PANIC("Illegal instruction encountered");
+        op.fn = illegal;
         break;
     }
-    self->clocks += instr.clocks;
+    return op;
+}
+
+void cpu_init_ops() {
+    static bool initialized = false;
+    int i;
+    if (initialized)
+        return;
+    for (i = 0; i < 0x100; i++) {
+        CPU_OPS[i] = resolve_op(&OP_TABLE[i]);
+        CPU_OPS[0x100 | i] = resolve_op(&CB_TABLE[i]);
+    }
+    /* The CB handler accounts for the clocks of the instruction it dispatches to */
+    CPU_OPS[0xCB].fn = prefix_cb;
+    CPU_OPS[0xCB].clocks = 0;
+    initialized = true;
+}
+
+/* Interrupts */
+uint8_t cpu_pending_interrupts(cpu *self) {
+    return self->bus->io[IO_IF_OFF] & self->bus->ie_reg & INT_MASK;
+}
+
+/*
+ * Runs between instructions. Any pending interrupt wakes a halted CPU, with IME set the one with
+ * the highest priority is acknowledged and called.
+ */
+void cpu_interrupt(cpu *self) {
+    uint8_t pending = cpu_pending_interrupts(self);
+    uint8_t i;
+
+    if (pending == 0)
+        return;
+    if (self->mode == cpu_halted_mode_e)
+        self->mode = cpu_running_mode_e;
+    if (!self->ime || self->ei_delay)
+        return;
+    for (i = 0; !(pending & (1 << i)); i++)
+        ;
+    self->ime = false;
+    self->bus->io[IO_IF_OFF] &= ~(1 << i);
+    set_sp_u16(self, get_pc(self));
+    set_pc(self, INT_VECTOR_START + i * INT_VECTOR_SIZE);
+    self->clocks += CLOCKS_PER_INTERRUPT;
+}
+
+uintptr_t cpu_clock(cpu *self) {
+    const op_t *op;
+    uintptr_t old_clocks = self->clocks;
+
+    if (self->mode == cpu_stop_mode_e)
+        return 0;
+    cpu_interrupt(self);
+    if (self->mode == cpu_halted_mode_e) {
+        self->clocks++;
+        return 1;
+    }
+    /* The instruction after EI runs before any interrupt is taken */
+    self->ei_delay = false;
+
+    TRACE(TRACE_CPU, trace_instr_e, self->pc, cpu_peek_u16(self, self->pc + 1),
+          cpu_read_bus(self, self->pc));
+    op = &CPU_OPS[cpu_fetch_u8(self)];
+    /* Operands are fetched up front, the same way blocks store them */
+    if (op->length >= 2)
+        self->imm = cpu_fetch_u8(self);
+    if (op->length == 3)
+        self->imm |= cpu_fetch_u8(self) << 8;
+    op->fn(self, op);
+    self->clocks += op->clocks;
+
+    return self->clocks - old_clocks;
+}
+
+/*
+ * Runs the decoded ops of b. Clocks are only checked against until when the block doesn't end
+ * before it, so a block takes exactly as long as single stepping it would. A write to cached
+ * code or a bank switch repoints pages and ends the block early, the remaining ops may be stale.
+ */
+void cpu_run_block(cpu *self, const block_t *b, uintptr_t until) {
+    const block_op_t *entry = b->ops;
+    const block_op_t *last = &b->ops[b->count - 1];
+    uint32_t map_gen = self->bus->map_gen;
+    uintptr_t start = self->clocks;
+    bool whole = start + last->clocks < until;
+
+#if defined(JIT) && !defined(TRACING)
+    if (whole && b->native != NULL) {
+        b->native(self);
+        return;
+    }
+#endif
+    for (;;) {
+        const op_t *op = &CPU_OPS[entry->op];
+        /* Only the last op can branch, so pc is at the start of this one */
+        TRACE(TRACE_CPU, trace_instr_e, self->pc, cpu_peek_u16(self, self->pc + 1),
+              cpu_read_bus(self, self->pc));
+        self->pc = b->pc + entry->end;
+        self->imm = entry->imm;
+        op->fn(self, op);
+        if (entry == last || self->bus->map_gen != map_gen ||
+            (!whole && start + entry->clocks >= until))
+            break;
+        /* Every op sees the time it starts at, as when single stepping. The timer depends on it */
+        self->clocks = start + entry->clocks;
+        entry++;
+    }
+    /* Branches may have added clocks of their own */
+    self->clocks += entry->clocks - (entry == b->ops ? 0 : entry[-1].clocks);
+}
+
+/*
+ * Once an idle block branched back to itself, nothing it reads changes before until and every
+ * further iteration that would run whole before it is skipped at once. Interrupts can't get in
+ * between either, whether one is taken only changes at events as well.
+ */
+void cpu_skip_idle(cpu *self, const block_t *b, uintptr_t start, uintptr_t until) {
+    uintptr_t iteration = self->clocks - start;
+    uintptr_t last = b->ops[b->count - 1].clocks;
 
+    if (self->pc != b->pc || until == SCHED_NEVER || self->clocks + last >= until)
+        return;
+    self->clocks += (until - last - self->clocks + iteration - 1) / iteration * iteration;
+}
+
+uintptr_t cpu_run(cpu *self, uintptr_t until) {
+    uintptr_t old_clocks = self->clocks;
+    while (self->clocks < until && self->mode != cpu_stop_mode_e) {
+        const block_t *b = NULL;
+        uintptr_t start = self->clocks;
+        cpu_interrupt(self);
+        if (self->mode == cpu_halted_mode_e) {
+            /* Nothing can wake it before until, unless nothing is ever due */
+            if (until != SCHED_NEVER)
+                self->clocks = until;
+            break;
+        }
+        if (self->ei_delay) {
+            cpu_clock(self);
+            continue;
+        }
+        if (self->blocks != NULL)
+            b = block_lookup(self->blocks, self->bus, self->pc);
+        /* Code outside of mapped pages, such as HRAM, is interpreted */
+        if (b == NULL) {
+            cpu_clock(self);
+            continue;
+        }
+        cpu_run_block(self, b, until);
+        if (b->idle)
+            cpu_skip_idle(self, b, start, until);
+    }
     return self->clocks - old_clocks;
 }
@@ -2,93 +2,133 @@
 #define CPU_H
 
 #include "bus.h"
-#include "decoder.h"
 #include "utils.h"
 #include <stdint.h>
-#ifdef __APPLE__
-#include <machine/endian.h>
-#elif __linux__
-#include <endian.h>
-#endif
 
-typedef struct cpu {
-    union __attribute((packed)) {
-        struct __attribute((packed)) {
-#if BIG_ENDIAN == 1
-            uint8_t a;
-            union {
-                struct __attribute((packed)) {
-                    uint8_t _ : 4;
-                    uint8_t c : 1;
-                    uint8_t h : 1;
-                    uint8_t n : 1;
-                    uint8_t z : 1;
-                } bits;
-                uint8_t u8;
-            } f;
-#else
-            union {
-                struct __attribute((packed)) {
-                    uint8_t _ : 4;
-                    uint8_t c : 1;
-                    uint8_t h : 1;
-                    uint8_t n : 1;
-                    uint8_t z : 1;
-                } bits;
-                uint8_t u8;
-            } f;
-            uint8_t a;
-#endif
-        } u8;
-        uint16_t u16;
-    } af;
-    union __attribute((packed)) {
-        struct __attribute((packed)) {
-#if BIG_ENDIAN == 1
-            uint8_t b;
-            uint8_t c;
-#else
-            uint8_t c;
-            uint8_t b;
-#endif
-        } u8;
-        uint16_t u16;
-    } bc;
-    union __attribute((packed)) {
-        struct __attribute((packed)) {
-#if BIG_ENDIAN == 1
-            uint8_t d;
-            uint8_t e;
-#else
-            uint8_t e;
-            uint8_t d;
-#endif
-        } u8;
-        uint16_t u16;
-    } de;
-    union __attribute((packed)) {
-        struct __attribute((packed)) {
-#if BIG_ENDIAN == 1
-            uint8_t h;
-            uint8_t l;
-#else
-            uint8_t l;
-            uint8_t h;
-#endif
-        } u8;
-        uint16_t u16;
-    } hl;
+#define FLAG_Z 0x80
+#define FLAG_N 0x40
+#define FLAG_H 0x20
+#define FLAG_C 0x10
+
+/* Interrupt i calls INT_VECTOR_START + i * INT_VECTOR_SIZE */
+#define INT_VECTOR_START 0x0040
+#define INT_VECTOR_SIZE 0x08
+#define CLOCKS_PER_INTERRUPT 5
+
+struct cpu;
+struct op;
+struct block_cache;
+
+/* Handler for a single opcode, with its operands already resolved into the op */
+typedef void (*op_handler)(struct cpu *self, const struct op *op);
+
+typedef struct op {
+    op_handler fn;
+    uint8_t lhs;
+    uint8_t rhs;
+    uint8_t clocks;
+    uint8_t length;
+} op_t;
+
+/*
+ * Indices into regs. B to A follow the 3-bit register field of opcodes, with F in the slot (hl)
+ * takes there. Register pairs are stored high byte first starting at their high register, which
+ * holds for BC, DE and HL, AF is only ever moved by PUSH and POP and gets handlers of its own.
+ */
+#define REG_B 0
+#define REG_C 1
+#define REG_D 2
+#define REG_E 3
+#define REG_H 4
+#define REG_L 5
+#define REG_F 6
+#define REG_A 7
+#define REG_BC REG_B
+#define REG_DE REG_D
+#define REG_HL REG_H
+
+/* struct cpu is aligned to this, so its hot fields always share a single line */
+#define CPU_CACHE_LINE 64
+
+typedef struct __attribute((aligned(CPU_CACHE_LINE))) cpu {
+    /* Hot state, touched by nearly every instruction, fits the first cache line */
+    uint8_t regs[8];
     uint16_t sp;
-    enum { cpu_running_mode_e, cpu_halted_mode_e, cpu_stop_mode_e } mode;
-    bus *bus;
+    uint16_t pc;
+    /* Immediate operand of the instruction being executed, fetched before its handler runs */
+    uint16_t imm;
+    /*
+     * Flags are derived when they are read rather than by every op setting them. The last such op
+     * records its operands and result here and F is only up to date while flag_op is flags_f_e:
+     * add and sub derive every flag from flag_lhs, flag_rhs and flag_res, zero only Z from
+     * flag_res with the other flags already in flag_lhs.
+     */
+    uint8_t flag_lhs;
+    uint8_t flag_rhs;
     uintptr_t clocks;
-    decoder_t decoder;
+    uint16_t flag_res;
+    enum { flags_f_e, flags_add_e, flags_sub_e, flags_zero_e } flag_op;
+    bus *bus;
+    /*
+     * Host pointer to the page instructions are fetched from. Valid while pc stays inside
+     * code_page_num and the bus mappings haven't changed since code_map_gen, code_page_num is
+     * PAGE_COUNT when nothing is cached.
+     */
+    const uint8_t *code_page;
+    uint32_t code_map_gen;
+    uint16_t code_page_num;
+    /* Interrupt master enable, EI only sets it after the instruction following it */
+    bool ime;
+    bool ei_delay;
+
+    /* Cold state */
+    enum { cpu_running_mode_e, cpu_halted_mode_e, cpu_stop_mode_e } mode;
+    /* Decoded blocks run by cpu_run, NULL to interpret one instruction at a time */
+    struct block_cache *blocks;
 } cpu;
 
 cpu cpu_new(bus *bus);
 
+/*
+ * Executes a single instruction, or dispatches a pending interrupt, returns the clocks it took. A
+ * halted CPU waits for a clock.
+ */
 uintptr_t cpu_clock(cpu *self);
+/*
+ * Executes instructions until clocks reaches until or the CPU stops, returns the clocks taken.
+ * Interrupts are only raised by events scheduled at until or later, so a halted CPU skips
+ * straight to it.
+ */
+uintptr_t cpu_run(cpu *self, uintptr_t until);
+
+/* Every opcode resolved to its handler, CB-prefixed opcodes start at 0x100 */
+extern op_t CPU_OPS[0x200];
+
+/* Handlers the JIT recognizes and translates itself instead of calling */
+void noop(cpu *self, const op_t *op);
+void ld_r_r(cpu *self, const op_t *op);
+void ld_r_n(cpu *self, const op_t *op);
+void ld_rr_nn(cpu *self, const op_t *op);
+void ld_sp_nn(cpu *self, const op_t *op);
+void inc_rr(cpu *self, const op_t *op);
+void dec_rr(cpu *self, const op_t *op);
+void inc_sp(cpu *self, const op_t *op);
+void dec_sp(cpu *self, const op_t *op);
+void jp(cpu *self, const op_t *op);
+void jr(cpu *self, const op_t *op);
+
+/* Brings F up to date and returns it, for anything reading AF or the flags as a whole */
+uint8_t cpu_get_f(cpu *self);
+void cpu_set_f(cpu *self, uint8_t n);
 
+uint16_t get_reg_af(cpu *self);
+uint16_t get_reg_bc(cpu *self);
+uint16_t get_reg_de(cpu *self);
+uint16_t get_reg_hl(cpu *self);
+void set_reg_af(cpu *self, uint16_t n);
+void set_reg_bc(cpu *self, uint16_t n);
+void set_reg_de(cpu *self, uint16_t n);
+void set_reg_hl(cpu *self, uint16_t n);
 uint16_t get_sp(cpu *self);
 uint8_t cpu_get_imm_u8(cpu *self);
 uint16_t cpu_get_imm_u16(cpu *self);
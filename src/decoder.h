@@ -9,6 +9,9 @@ typedef struct {
     uintptr_t size;
 } decoder_t;
 
+extern const instruction_t OP_TABLE[0x100];
+extern const instruction_t CB_TABLE[0x100];
+
 decoder_t decoder_new(const uint8_t *arr, uintptr_t size);
 instruction_t decoder_next(decoder_t *d);
 
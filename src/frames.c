@@ -0,0 +1,38 @@
+#include "frames.h"
+#include <string.h>
+
+#define FRAME_FRESH 0x04
+#define FRAME_INDEX 0x03
+
+frame_queue frame_queue_new() {
+    frame_queue q;
+    memset(q.buffers, 0, sizeof(q.buffers));
+    q.back = 0;
+    q.middle = 1;
+    q.front = 2;
+    return q;
+}
+
+uint8_t (*frame_queue_back(frame_queue *self))[WIDTH] {
+    return self->buffers[self->back];
+}
+
+void frame_queue_publish(frame_queue *self) {
+    /* Release makes the frame visible to the consumer, acquire the buffer it handed back */
+    uint8_t old = __atomic_exchange_n(&self->middle, self->back | FRAME_FRESH, __ATOMIC_ACQ_REL);
+    self->back = old & FRAME_INDEX;
+}
+
+bool frame_queue_acquire(frame_queue *self) {
+    uint8_t old;
+    if (!(__atomic_load_n(&self->middle, __ATOMIC_RELAXED) & FRAME_FRESH))
+        return false;
+    /* Only the producer sets FRAME_FRESH, the buffer swapped in is never lost */
+    old = __atomic_exchange_n(&self->middle, self->front, __ATOMIC_ACQ_REL);
+    self->front = old & FRAME_INDEX;
+    return true;
+}
+
+const uint8_t (*frame_queue_front(frame_queue *self))[WIDTH] {
+    return (const uint8_t(*)[WIDTH])self->buffers[self->front];
+}
@@ -0,0 +1,33 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include "ppu.h"
+#include "utils.h"
+
+/*
+ * Lock-free triple buffer handing completed frames from the emulation thread to the thread
+ * presenting them. The producer always has a buffer to draw into and the consumer always has the
+ * latest published frame to read, neither ever waits. Frames the consumer was too slow for are
+ * dropped, only the newest one is kept.
+ */
+typedef struct {
+    uint8_t buffers[3][HEIGHT][WIDTH];
+    /* Buffer owned by the producer */
+    uint8_t back;
+    /* Buffer last published or consumed, with FRAME_FRESH set while it has yet to be consumed */
+    uint8_t middle;
+    /* Buffer owned by the consumer */
+    uint8_t front;
+} frame_queue;
+
+frame_queue frame_queue_new();
+/* Buffer to draw the next frame into, only used by the producer */
+uint8_t (*frame_queue_back(frame_queue *self))[WIDTH];
+/* Makes the back buffer the latest frame and takes over a free one */
+void frame_queue_publish(frame_queue *self);
+/* Makes the latest frame the front buffer if one was published since, returns whether it did */
+bool frame_queue_acquire(frame_queue *self);
+/* Frame the consumer last acquired */
+const uint8_t (*frame_queue_front(frame_queue *self))[WIDTH];
+
+#endif
@@ -1,30 +1,93 @@
+#define _POSIX_C_SOURCE 200112L
 #include "gameboy.h"
+#include "block.h"
+#include "trace.h"
 #include <stdlib.h>
 
+/* malloc doesn't honour the cache line alignment of struct cpu */
+gamegirl *gamegirl_alloc() {
+    void *gg = NULL;
+    if (posix_memalign(&gg, CPU_CACHE_LINE, sizeof(gamegirl)) != 0)
+        PANIC("allocating gamegirl failed");
+    return gg;
+}
+
 gamegirl *gamegirl_init(char *path) {
-    gamegirl *gg = malloc(sizeof(gamegirl));
+    gamegirl *gg = gamegirl_alloc();
     cartridge_t cart;
     cart = cartridge_new(path);
     gg->step = true;
     gg->bus = bus_new(cart);
+    bus_remap(&gg->bus);
     gg->ppu = ppu_new(&gg->bus);
     gg->cpu = cpu_new(&gg->bus);
-    gg->schedule_clocks = 0;
+    gg->cpu.blocks = block_cache_new();
+    gg->sched = scheduler_new(&gg->cpu.clocks);
+    gg->bus.sched = &gg->sched;
+    scheduler_schedule(&gg->sched, sched_ppu_e, gg->ppu.clocks);
+    trace_init(&gg->cpu.clocks);
     return gg;
 }
 
-void gamegirl_clock(gamegirl *gg) {
-    /* LOG("Scheduler", "CPU clocks: %lu", gg->cpu.clocks); */
-    /* LOG("Scheduler", "PPU clocks: %lu", gg->ppu.clocks); */
-    if (gg->schedule_clocks >= 0) {
-        /* LOG("Scheduler", "Clocking CPU"); */
-        gg->schedule_clocks -= cpu_clock(&gg->cpu);
-    } else {
-        /* LOG("Scheduler", "Clocking PPU"); */
-        gg->schedule_clocks += ppu_clock(&gg->ppu);
-        gg->schedule_clocks += ppu_clock(&gg->ppu);
+void gamegirl_rebase(gamegirl *gg) {
+    gg->cpu.bus = &gg->bus;
+    gg->cpu.code_page_num = PAGE_COUNT;
+    if (gg->cpu.blocks != NULL)
+        block_cache_flush(gg->cpu.blocks);
+    gg->bus.sched = &gg->sched;
+    gg->sched.clocks = &gg->cpu.clocks;
+    ppu_map_registers(&gg->ppu, &gg->bus);
+    mbc_update(&gg->bus.cart);
+    bus_remap(&gg->bus);
+    bus_decode_tiles(&gg->bus);
+    bus_decode_palettes(&gg->bus);
+    bus_index_objs(&gg->bus);
+}
+
+gamegirl *gamegirl_clone(gamegirl *gg) {
+    gamegirl *copy = gamegirl_alloc();
+    *copy = *gg;
+    copy->bus.cart = cartridge_clone(&gg->bus.cart);
+    if (gg->cpu.blocks != NULL)
+        copy->cpu.blocks = block_cache_new();
+    gamegirl_rebase(copy);
+    return copy;
+}
+
+void gamegirl_dispatch(gamegirl *gg, sched_event_t event) {
+    switch (event) {
+    case sched_ppu_e:
+        ppu_clock(&gg->ppu);
+        scheduler_schedule(&gg->sched, sched_ppu_e, gg->ppu.clocks);
+        break;
+    case sched_serial_e:
+        bus_serial_complete(&gg->bus);
+        break;
+    case sched_dma_e:
+        bus_dma_complete(&gg->bus);
+        break;
+    case sched_timer_e:
+        bus_timer_overflow(&gg->bus);
+        break;
+    case SCHED_EVENT_COUNT:
+        break;
     }
 }
-void gamegirl_free(gamegirl gg) {
-    bus_free(gg.bus);
+
+/* Runs the CPU up to the next scheduled event, then handles every event that is due */
+void gamegirl_clock(gamegirl *gg) {
+    uintptr_t next = scheduler_next(&gg->sched);
+    uintptr_t when;
+    int event;
+
+    /* A stopped CPU makes no progress, nothing can wake it up yet */
+    cpu_run(&gg->cpu, next);
+    while ((event = scheduler_pop(&gg->sched, gg->cpu.clocks, &when)) >= 0)
+        gamegirl_dispatch(gg, event);
+}
+void gamegirl_free(gamegirl *gg) {
+    trace_dump();
+    block_cache_free(gg->cpu.blocks);
+    ppu_free(gg->ppu);
+    bus_free(gg->bus);
 }
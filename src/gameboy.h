@@ -4,18 +4,23 @@
 #include "bus.h"
 #include "cpu.h"
 #include "ppu.h"
+#include "scheduler.h"
 
 typedef struct gamegirl {
     bool step;
     cpu cpu;
     ppu ppu;
     bus bus;
-    int32_t schedule_clocks;
+    scheduler sched;
 } gamegirl;
 
 gamegirl *gamegirl_init();
+/* Repoints every internal pointer of gg at gg itself, required after it was copied or restored */
+void gamegirl_rebase(gamegirl *gg);
+/* Independent copy of gg sharing only the read-only ROM image */
+gamegirl *gamegirl_clone(gamegirl *gg);
 
 void gamegirl_clock(gamegirl *gg);
-void gamegirl_free(gamegirl gg);
+void gamegirl_free(gamegirl *gg);
 
 #endif
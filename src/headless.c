@@ -0,0 +1,148 @@
+#include "gameboy.h"
+#include "savestate.h"
+#include "utils.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_FRAMES 60
+#define DEFAULT_PREFIX "headless"
+#define PATH_MAX_LEN 4096
+
+/* Shades are stored as 0 (lightest) to 3 (darkest) */
+const uint8_t PGM_SHADES[4] = {0xFF, 0xAA, 0x55, 0x00};
+
+void usage(char *name) {
+    fprintf(stderr,
+            "usage: %s [-f frames] [-c cycles] [-r ratio] [-o prefix] [-l state] [-s state]"
+            " [rom]\n",
+            name);
+    exit(EXIT_FAILURE);
+}
+
+uintptr_t parse_count(char *name, char *arg) {
+    char *end;
+    unsigned long n;
+    if (arg == NULL)
+        usage(name);
+    n = strtoul(arg, &end, 0);
+    if (*end != '\0')
+        usage(name);
+    return n;
+}
+
+void write_framebuffer(gamegirl *gg, char *path) {
+    FILE *f = fopen(path, "wb");
+    uint8_t row[WIDTH];
+    int y;
+    int x;
+
+    if (f == NULL)
+        PANIC("could not open %s", path);
+    fprintf(f, "P5\n%d %d\n255\n", WIDTH, HEIGHT);
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < WIDTH; x++)
+            row[x] = PGM_SHADES[gg->ppu.framebuffer[y][x] & 0x03];
+        fwrite(row, 1, WIDTH, f);
+    }
+    fclose(f);
+}
+
+void write_state(gamegirl *gg, char *path) {
+    FILE *f = fopen(path, "w");
+    cpu *c = &gg->cpu;
+
+    if (f == NULL)
+        PANIC("could not open %s", path);
+    fprintf(f, "af %#06x\n", get_reg_af(c));
+    fprintf(f, "bc %#06x\n", get_reg_bc(c));
+    fprintf(f, "de %#06x\n", get_reg_de(c));
+    fprintf(f, "hl %#06x\n", get_reg_hl(c));
+    fprintf(f, "sp %#06x\n", c->sp);
+    fprintf(f, "pc %#06x\n", c->pc);
+    fprintf(f, "mode %d\n", (int)c->mode);
+    fprintf(f, "clocks %lu\n", (unsigned long)c->clocks);
+    fprintf(f, "frames %lu\n", (unsigned long)gg->ppu.frames);
+    fprintf(f, "lcdc %#04x\n", bus_read(&gg->bus, 0xFF40));
+    fprintf(f, "stat %#04x\n", bus_read(&gg->bus, 0xFF41));
+    fprintf(f, "ly %#04x\n", bus_read(&gg->bus, 0xFF44));
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    gamegirl *gg;
+    char *path = NULL;
+    char *prefix = DEFAULT_PREFIX;
+    char *load = NULL;
+    char *save = NULL;
+    char out[PATH_MAX_LEN];
+    uintptr_t frames = 0;
+    uintptr_t cycles = 0;
+    uintptr_t ratio = 1;
+    uintptr_t start_frames;
+    uintptr_t start_clocks;
+    int status = EXIT_SUCCESS;
+    int i;
+
+    signal(SIGSEGV, panic_handler);
+    signal(SIGABRT, panic_handler);
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0)
+            frames = parse_count(argv[0], argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0)
+            cycles = parse_count(argv[0], argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0)
+            ratio = parse_count(argv[0], argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            prefix = argv[++i];
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+            load = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            save = argv[++i];
+        else if (argv[i][0] == '-' || path != NULL)
+            usage(argv[0]);
+        else
+            path = argv[i];
+    }
+    if (frames == 0 && cycles == 0)
+        frames = DEFAULT_FRAMES;
+    if (frames == 0)
+        frames = (uintptr_t)-1;
+    if (cycles == 0)
+        cycles = (uintptr_t)-1;
+    if (ratio > 0xFFFF)
+        usage(argv[0]);
+
+    gg = gamegirl_init(path);
+    if (load != NULL && !savestate_load_file(gg, load))
+        PANIC("could not load state %s", load);
+    /* Limits count from the restored state onwards */
+    start_frames = gg->ppu.frames;
+    start_clocks = gg->cpu.clocks;
+    /* Frames only drawn one in ratio, or not at all for 0, the last one of -f always is */
+    gg->ppu.render_ratio = ratio;
+    while (gg->ppu.frames - start_frames < frames && gg->cpu.clocks - start_clocks < cycles) {
+        /* Nothing wakes the CPU up from STOP yet, so give up instead of spinning forever */
+        if (gg->cpu.mode == cpu_stop_mode_e) {
+            fprintf(stderr, "CPU stopped after %lu clocks\n", (unsigned long)gg->cpu.clocks);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (gg->ppu.frames - start_frames == frames - 1)
+            gg->ppu.render_ratio = 1;
+        gamegirl_clock(gg);
+    }
+
+    sprintf(out, "%.*s.pgm", PATH_MAX_LEN - 5, prefix);
+    write_framebuffer(gg, out);
+    sprintf(out, "%.*s.txt", PATH_MAX_LEN - 5, prefix);
+    write_state(gg, out);
+    if (save != NULL && !savestate_save_file(gg, save))
+        PANIC("could not save state %s", save);
+
+    gamegirl_free(gg);
+    free(gg);
+    return status;
+}
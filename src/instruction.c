@@ -64,7 +64,7 @@ uint8_t get_raw_size_argument_t(argument_t *arg) {
 }
 
 char *print_argument_t(argument_t *arg) {
-    char *str = malloc(ARG_MAX_LEN);
+    char *str = calloc(ARG_MAX_LEN, 1);
     switch (arg->e) {
     case none_e:
         strncat(str, "", ARG_MAX_LEN - 1);
@@ -181,7 +181,7 @@ char *print_argument_t(argument_t *arg) {
 }
 
 char *print_instruction(instruction_t *instr) {
-    char *str = malloc(INSTR_MAX_LEN);
+    char *str = calloc(INSTR_MAX_LEN, 1);
     char *lhs = print_argument_t(&instr->lhs);
     char *rhs = print_argument_t(&instr->rhs);
     switch (instr->instruction_type) {
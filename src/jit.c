@@ -0,0 +1,308 @@
+#define _DEFAULT_SOURCE
+#include "jit.h"
+#include "block.h"
+#include "decoder.h"
+#include "utils.h"
+#include <stddef.h>
+#include <sys/mman.h>
+
+/*
+ * Translated blocks are called as void fn(cpu *self) and keep self in rbx, the bus in r13 and the
+ * map_gen the block started with in r12. Guest registers are read and written in place through
+ * rbx, most ops still call their handler and the flags are derived lazily by them, so holding
+ * them in host registers would mean spilling them around nearly every op.
+ */
+
+#define CPU_OFF(member) ((uint32_t)offsetof(cpu, member))
+#define REG_OFF(r) (CPU_OFF(regs) + (r))
+
+/* ModRM reg field and rm = rbx with a 32 bit displacement */
+#define MODRM_RBX_DISP32(reg) (0x80 | ((reg) << 3) | 0x03)
+
+typedef struct {
+    uint8_t *p;
+    /* Clocks of the block already added to the CPU's clock counter */
+    uint8_t clocks;
+} emitter;
+
+void emit_u8(emitter *e, uint8_t n) {
+    *e->p++ = n;
+}
+
+void emit_u16(emitter *e, uint16_t n) {
+    emit_u8(e, n & 0xFF);
+    emit_u8(e, n >> 8);
+}
+
+void emit_u32(emitter *e, uint32_t n) {
+    emit_u16(e, n & 0xFFFF);
+    emit_u16(e, n >> 16);
+}
+
+void emit_u64(emitter *e, uint64_t n) {
+    emit_u32(e, n & 0xFFFFFFFF);
+    emit_u32(e, n >> 32);
+}
+
+/* opcode reg, [rbx + disp] */
+void emit_rbx_op(emitter *e, uint8_t opcode, uint8_t reg, uint32_t disp) {
+    emit_u8(e, opcode);
+    emit_u8(e, MODRM_RBX_DISP32(reg));
+    emit_u32(e, disp);
+}
+
+/* mov word [rbx + disp], n */
+void emit_store_u16(emitter *e, uint32_t disp, uint16_t n) {
+    emit_u8(e, 0x66);
+    emit_rbx_op(e, 0xC7, 0, disp);
+    emit_u16(e, n);
+}
+#define STORE_U16_SIZE 9
+
+/* add qword [rbx + clocks], n */
+void emit_add_clocks(emitter *e, uint32_t n) {
+    emit_u8(e, 0x48);
+    emit_rbx_op(e, 0x81, 0, CPU_OFF(clocks));
+    emit_u32(e, n);
+}
+#define ADD_CLOCKS_SIZE 11
+
+void emit_prologue(emitter *e) {
+    emit_u8(e, 0x53);    /* push rbx */
+    emit_u16(e, 0x5441); /* push r12 */
+    emit_u16(e, 0x5541); /* push r13 */
+    emit_u8(e, 0x48);    /* mov rbx, rdi */
+    emit_u16(e, 0xFB89);
+    emit_u8(e, 0x4C); /* mov r13, [rbx + bus] */
+    emit_rbx_op(e, 0x8B, 5, CPU_OFF(bus));
+    emit_u8(e, 0x45); /* mov r12d, [r13 + map_gen] */
+    emit_u16(e, 0xA58B);
+    emit_u32(e, offsetof(bus, map_gen));
+}
+
+void emit_epilogue(emitter *e) {
+    emit_u16(e, 0x5D41); /* pop r13 */
+    emit_u16(e, 0x5C41); /* pop r12 */
+    emit_u8(e, 0x5B);    /* pop rbx */
+    emit_u8(e, 0xC3);    /* ret */
+}
+#define EPILOGUE_SIZE 6
+
+/* Sets ZF when (F & mask) == value, the condition of a taken branch */
+void emit_cond(emitter *e, const op_t *op) {
+    /* F may be out of date, cpu_get_f returns it in al */
+    emit_u8(e, 0x48); /* mov rdi, rbx */
+    emit_u16(e, 0xDF89);
+    emit_u16(e, 0xB848); /* mov rax, cpu_get_f */
+    emit_u64(e, (uintptr_t)cpu_get_f);
+    emit_u16(e, 0xD0FF); /* call rax */
+    emit_u8(e, 0x24);    /* and al, mask */
+    emit_u8(e, op->lhs);
+    emit_u8(e, 0x3C); /* cmp al, value */
+    emit_u8(e, op->rhs);
+}
+
+/* Calls the interpreter's handler with the immediate set up like cpu_run_block does */
+void emit_call(emitter *e, const op_t *op, const block_op_t *entry) {
+    if (entry->op < 0x100 && op->length >= 2)
+        emit_store_u16(e, CPU_OFF(imm), entry->imm);
+    emit_u8(e, 0x48); /* mov rdi, rbx */
+    emit_u16(e, 0xDF89);
+    emit_u16(e, 0xBE48); /* mov rsi, op */
+    emit_u64(e, (uintptr_t)op);
+    emit_u16(e, 0xB848); /* mov rax, handler */
+    emit_u64(e, (uintptr_t)op->fn);
+    emit_u16(e, 0xD0FF); /* call rax */
+}
+
+/* Leaves the block if the handler repointed a page, the rest of it may no longer be valid */
+void emit_map_check(emitter *e, uint8_t clocks) {
+    emit_u8(e, 0x45); /* cmp [r13 + map_gen], r12d */
+    emit_u16(e, 0xA539);
+    emit_u32(e, offsetof(bus, map_gen));
+    emit_u8(e, 0x74); /* je over the exit */
+    emit_u8(e, ADD_CLOCKS_SIZE + EPILOGUE_SIZE);
+    emit_add_clocks(e, clocks - e->clocks);
+    emit_epilogue(e);
+}
+
+/* Brings the clock counter up to the start of the op, for accesses that may reach the timer */
+void emit_sync_clocks(emitter *e, const block_t *b, uint8_t i) {
+    uint8_t clocks = i == 0 ? 0 : b->ops[i - 1].clocks;
+    if (clocks == e->clocks)
+        return;
+    emit_add_clocks(e, clocks - e->clocks);
+    e->clocks = clocks;
+}
+
+/* Only ops writing memory can repoint pages, through bank switches or writes to cached code */
+bool jit_may_write(const block_op_t *entry) {
+    const instruction_t *instr;
+    if (entry->op >= 0x100)
+        instr = &CB_TABLE[entry->op & 0xFF];
+    else
+        instr = &OP_TABLE[entry->op];
+    switch (instr->lhs.e) {
+    case register_ptr_e:
+    case hl_ptr_e:
+    case imm_u16_ptr_e:
+    case io_offset_u8_e:
+    case io_offset_c_e:
+        return true;
+    default:
+        /* SET and RES write back to (HL), which is their second operand */
+        if ((instr->instruction_type == set_instruction ||
+             instr->instruction_type == res_instruction) &&
+            (instr->rhs.e == register_ptr_e || instr->rhs.e == hl_ptr_e))
+            return true;
+        return instr->instruction_type == push_instruction ||
+               instr->instruction_type == call_instruction ||
+               instr->instruction_type == rst_instruction;
+    }
+}
+
+/* Accesses through a register pair may go anywhere, including the timer registers */
+bool jit_accesses_pointer(const block_op_t *entry) {
+    const instruction_t *instr;
+    if (entry->op >= 0x100)
+        instr = &CB_TABLE[entry->op & 0xFF];
+    else
+        instr = &OP_TABLE[entry->op];
+    return instr->lhs.e == register_ptr_e || instr->lhs.e == hl_ptr_e ||
+           instr->rhs.e == register_ptr_e || instr->rhs.e == hl_ptr_e;
+}
+
+/* Ops reaching 0xFF00-0xFFFF depend on the exact time they run at and are never translated */
+bool jit_touches_io(const block_op_t *entry) {
+    switch (entry->op) {
+    case 0xE0:
+    case 0xE2:
+    case 0xF0:
+    case 0xF2:
+        return true;
+    case 0xEA:
+    case 0xFA:
+        return entry->imm >= IO_START;
+    default:
+        return false;
+    }
+}
+
+bool jit_can_compile(const block_t *b, bus *bus) {
+    uint8_t page = b->pc >> PAGE_SHIFT;
+    uint8_t i;
+    /* Writable memory can be modified under the translation */
+    if (bus_page_writable(bus, page) || bus->code_pages[page])
+        return false;
+    for (i = 0; i < b->count; i++) {
+        if (jit_touches_io(&b->ops[i]))
+            return false;
+    }
+    return true;
+}
+
+void jit_emit_op(emitter *e, const block_t *b, uint8_t i) {
+    const block_op_t *entry = &b->ops[i];
+    const op_t *op = &CPU_OPS[entry->op];
+    uint16_t pc = b->pc + entry->end;
+    bool last = i == b->count - 1;
+
+    if (op->fn == noop) {
+        /* Nothing to do */
+    } else if (op->fn == ld_r_r) {
+        emit_rbx_op(e, 0x8A, 0, REG_OFF(op->rhs)); /* mov al, [rbx + rhs] */
+        emit_rbx_op(e, 0x88, 0, REG_OFF(op->lhs)); /* mov [rbx + lhs], al */
+    } else if (op->fn == ld_r_n) {
+        emit_rbx_op(e, 0xC6, 0, REG_OFF(op->lhs)); /* mov byte [rbx + lhs], n */
+        emit_u8(e, entry->imm);
+    } else if (op->fn == ld_rr_nn) {
+        /* Pairs are stored high byte first */
+        emit_store_u16(e, REG_OFF(op->lhs), (entry->imm >> 8) | (entry->imm << 8));
+    } else if (op->fn == ld_sp_nn) {
+        emit_store_u16(e, CPU_OFF(sp), entry->imm);
+    } else if (op->fn == inc_rr || op->fn == dec_rr) {
+        emit_u8(e, 0x66); /* mov ax, [rbx + lhs] */
+        emit_rbx_op(e, 0x8B, 0, REG_OFF(op->lhs));
+        emit_u32(e, 0x08C0C166);      /* rol ax, 8 */
+        emit_u16(e, 0xFF66);          /* inc / dec ax */
+        emit_u8(e, op->fn == inc_rr ? 0xC0 : 0xC8);
+        emit_u32(e, 0x08C0C166);      /* rol ax, 8 */
+        emit_u8(e, 0x66);             /* mov [rbx + lhs], ax */
+        emit_rbx_op(e, 0x89, 0, REG_OFF(op->lhs));
+    } else if (op->fn == inc_sp || op->fn == dec_sp) {
+        emit_u8(e, 0x66); /* inc / dec word [rbx + sp] */
+        emit_rbx_op(e, 0xFF, op->fn == inc_sp ? 0 : 1, CPU_OFF(sp));
+    } else if (op->fn == jp || op->fn == jr) {
+        bool relative = op->fn == jr;
+        uint16_t target = relative ? (uint16_t)(pc + (int8_t)entry->imm) : entry->imm;
+        if (op->lhs != 0) {
+            emit_store_u16(e, CPU_OFF(pc), pc);
+            emit_cond(e, op);
+            emit_u8(e, 0x75); /* jne over the taken path */
+            emit_u8(e, STORE_U16_SIZE + ADD_CLOCKS_SIZE);
+        }
+        emit_store_u16(e, CPU_OFF(pc), target);
+        /* A taken relative or conditional jump takes a clock more, like in jr and jp */
+        if (relative || op->lhs != 0)
+            emit_add_clocks(e, 1);
+    } else if (last || jit_may_write(entry)) {
+        if (jit_accesses_pointer(entry))
+            emit_sync_clocks(e, b, i);
+        /* Branches read pc, and it has to be right if the block is left after this op */
+        emit_store_u16(e, CPU_OFF(pc), pc);
+        emit_call(e, op, entry);
+        if (!last)
+            emit_map_check(e, entry->clocks);
+    } else {
+        if (jit_accesses_pointer(entry))
+            emit_sync_clocks(e, b, i);
+        emit_call(e, op, entry);
+    }
+
+    /* Handlers and branches already left pc where the block continues */
+    if (last && (op->fn == noop || op->fn == ld_r_r || op->fn == ld_r_n || op->fn == ld_rr_nn ||
+                 op->fn == ld_sp_nn || op->fn == inc_rr || op->fn == dec_rr || op->fn == inc_sp ||
+                 op->fn == dec_sp))
+        emit_store_u16(e, CPU_OFF(pc), pc);
+}
+
+jit_arena jit_arena_new() {
+    jit_arena a;
+    a.code = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (a.code == MAP_FAILED)
+        PANIC("mapping jit arena failed");
+    a.used = 0;
+    return a;
+}
+
+void jit_arena_reset(jit_arena *self) {
+    self->used = 0;
+}
+
+jit_fn jit_compile(jit_arena *self, const block_t *b, bus *bus) {
+    emitter e;
+    uint8_t *start = self->code + self->used;
+    uint8_t i;
+
+    if (!jit_can_compile(b, bus) || self->used + JIT_BLOCK_MAX_SIZE > JIT_ARENA_SIZE)
+        return NULL;
+    /* Never writable and executable at the same time */
+    if (mprotect(self->code, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE) != 0)
+        PANIC("unprotecting jit arena failed");
+    e.p = start;
+    e.clocks = 0;
+    emit_prologue(&e);
+    for (i = 0; i < b->count; i++)
+        jit_emit_op(&e, b, i);
+    emit_add_clocks(&e, b->ops[b->count - 1].clocks - e.clocks);
+    emit_epilogue(&e);
+    if (mprotect(self->code, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC) != 0)
+        PANIC("protecting jit arena failed");
+
+    self->used += e.p - start;
+    return (jit_fn)(uintptr_t)start;
+}
+
+void jit_arena_free(jit_arena self) {
+    munmap(self.code, JIT_ARENA_SIZE);
+}
@@ -0,0 +1,37 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "bus.h"
+#include "cpu.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Translates hot blocks into x86-64 code. Only blocks decoded from read-only memory that don't
+ * access I/O registers are translated, everything else keeps running through cpu_run_block.
+ */
+
+/* Runs of a block before it is translated */
+#define JIT_THRESHOLD 16
+#define JIT_ARENA_SIZE 0x400000
+/* Upper bound on the code emitted for a single block */
+#define JIT_BLOCK_MAX_SIZE 0x800
+
+struct block;
+
+/* Runs a whole block, only called when it finishes before the next scheduled event */
+typedef void (*jit_fn)(cpu *self);
+
+typedef struct {
+    uint8_t *code;
+    size_t used;
+} jit_arena;
+
+jit_arena jit_arena_new();
+/* Drops every translation, callers forget the jit_fn they were handed */
+void jit_arena_reset(jit_arena *self);
+/* Translation of b, or NULL if it has to stay interpreted */
+jit_fn jit_compile(jit_arena *self, const struct block *b, bus *bus);
+void jit_arena_free(jit_arena self);
+
+#endif
@@ -1,18 +1,141 @@
+#define _POSIX_C_SOURCE 199506L
+#include "frames.h"
 #include "gameboy.h"
+#include "pixel.h"
 #include "utils.h"
+#include <SDL.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define FRAMES_PER_SEC 60
-#define CYCLES_PER_SEC 4194304
-#define CYCLES_PER_FRAME (CYCLES_PER_SEC / FRAMES_PER_SEC)
+#define SECS_PER_FRAME (1.0 / FRAMES_PER_SEC)
+/* How long either thread sleeps when it has nothing to do */
+#define IDLE_NSECS 1000000
 
-int main(int argc, char **argv) {
+/* ARGB8888 colors for shades 0 (lightest) to 3 (darkest) */
+const uint32_t GB_PALETTE[4] = {0xFFFFFFFF, 0xFFCCCCCC, 0xFF777777, 0xFF000000};
+
+typedef struct {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    uint32_t pixels[HEIGHT][WIDTH];
+} display;
+
+/*
+ * Shared between the emulation thread, which owns gg, and the UI thread, which owns the display
+ * and SDL events. Besides the frames only gg->step and these fields cross over, atomically.
+ */
+typedef struct {
     gamegirl *gg;
+    frame_queue frames;
+    /* Set by the UI thread to stop the emulation thread */
+    bool quit;
+    /* Calls to gamegirl_clock requested with J while stepping */
+    uintptr_t steps;
+} emulator;
+
+void sdl_panic() {
+    printf("SDL ERROR: %s", SDL_GetError());
+    exit(EXIT_FAILURE);
+}
+
+void display_init(display *self) {
+    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
+        sdl_panic();
+    if (SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, 0, &self->window, &self->renderer))
+        sdl_panic();
+    self->texture = SDL_CreateTexture(self->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                      SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+    if (self->texture == NULL)
+        sdl_panic();
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void sleep_nsecs(long nsecs) {
     struct timespec req;
+    req.tv_sec = nsecs / 1000000000;
+    req.tv_nsec = nsecs % 1000000000;
+    nanosleep(&req, NULL);
+}
+
+/* Uploads a frame of shades as one texture */
+void display_present(display *self, const uint8_t (*shades)[WIDTH]) {
+    PIXEL_KERNELS.expand(shades[0], self->pixels[0], WIDTH * HEIGHT, GB_PALETTE);
+    if (SDL_UpdateTexture(self->texture, NULL, self->pixels, sizeof(self->pixels[0])) != 0)
+        sdl_panic();
+    SDL_RenderClear(self->renderer);
+    SDL_RenderCopy(self->renderer, self->texture, NULL, NULL);
+    SDL_RenderPresent(self->renderer);
+}
+
+/*
+ * Runs the emulation at FRAMES_PER_SEC, or one clock per request while stepping, and publishes
+ * every completed frame. Presenting never holds it up.
+ */
+void *emulate(void *arg) {
+    emulator *self = arg;
+    gamegirl *gg = self->gg;
+    uintptr_t frames = gg->ppu.frames;
+    double deadline = now();
+    bool step;
+
+    while (!__atomic_load_n(&self->quit, __ATOMIC_ACQUIRE)) {
+        step = __atomic_load_n(&gg->step, __ATOMIC_ACQUIRE);
+        if (step) {
+            uintptr_t steps = __atomic_exchange_n(&self->steps, 0, __ATOMIC_ACQ_REL);
+            if (steps == 0)
+                sleep_nsecs(IDLE_NSECS);
+            while (steps-- > 0)
+                gamegirl_clock(gg);
+            /* Running resumes at full speed from wherever stepping left it */
+            deadline = now();
+        } else {
+            uintptr_t clocks = gg->cpu.clocks;
+            gamegirl_clock(gg);
+            /* A stopped CPU makes no progress, so idle instead of spinning until quit */
+            if (gg->cpu.clocks == clocks)
+                sleep_nsecs(IDLE_NSECS);
+        }
+        if (gg->ppu.frames == frames)
+            continue;
+        frames = gg->ppu.frames;
+        memcpy(frame_queue_back(&self->frames), gg->ppu.framebuffer,
+               sizeof(gg->ppu.framebuffer));
+        frame_queue_publish(&self->frames);
+        if (step)
+            continue;
+        /* Catching up is limited to a frame, after a stall the schedule starts over */
+        deadline += SECS_PER_FRAME;
+        if (deadline < now() - SECS_PER_FRAME)
+            deadline = now();
+        if (deadline > now())
+            sleep_nsecs((deadline - now()) * 1e9);
+    }
+    return NULL;
+}
+
+void display_free(display *self) {
+    SDL_DestroyTexture(self->texture);
+    SDL_DestroyRenderer(self->renderer);
+    SDL_DestroyWindow(self->window);
+    SDL_Quit();
+}
+
+int main(int argc, char **argv) {
+    emulator *emu;
+    display *disp;
+    pthread_t thread;
     char *path;
     SDL_Event e;
     bool quit = false;
@@ -25,21 +148,27 @@ int main(int argc, char **argv) {
     } else {
         path = NULL;
     }
-    gg = gamegirl_init(path);
+    emu = malloc(sizeof(emulator));
+    emu->gg = gamegirl_init(path);
+    emu->frames = frame_queue_new();
+    emu->quit = false;
+    emu->steps = 0;
+    disp = malloc(sizeof(display));
+    display_init(disp);
+    if (pthread_create(&thread, NULL, emulate, emu) != 0)
+        PANIC("could not start the emulation thread");
 
-    req.tv_sec = 0;
-    req.tv_nsec = CYCLES_PER_FRAME;
     while (!quit) {
         while (SDL_PollEvent(&e)) {
             switch (e.type) {
             case SDL_KEYDOWN:
                 switch (e.key.keysym.scancode) {
                 case SDL_SCANCODE_J:
-                    if (gg->step)
-                        gamegirl_clock(gg);
+                    if (__atomic_load_n(&emu->gg->step, __ATOMIC_ACQUIRE))
+                        __atomic_add_fetch(&emu->steps, 1, __ATOMIC_ACQ_REL);
                     break;
                 case SDL_SCANCODE_G:
-                    gg->step = !gg->step;
+                    __atomic_xor_fetch(&emu->gg->step, 1, __ATOMIC_ACQ_REL);
                     break;
                 default:
                     break;
@@ -52,11 +181,18 @@ int main(int argc, char **argv) {
                 break;
             }
         }
-        if (!gg->step) {
-            gamegirl_clock(gg);
-        }
-        nanosleep(&req, NULL);
+        if (frame_queue_acquire(&emu->frames))
+            display_present(disp, frame_queue_front(&emu->frames));
+        else
+            sleep_nsecs(IDLE_NSECS);
     }
 
+    __atomic_store_n(&emu->quit, true, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+    display_free(disp);
+    free(disp);
+    gamegirl_free(emu->gg);
+    free(emu->gg);
+    free(emu);
     return 0;
 }
@@ -0,0 +1,138 @@
+#include "mbc.h"
+#include "cartridge.h"
+#include <string.h>
+
+/* Indexed by the RAM size code at 0x0149, 2 KiB RAM is rounded up to a whole bank */
+const size_t MBC_RAM_SIZES[6] = {0, RAM_BANK_SIZE, RAM_BANK_SIZE, 0x8000, 0x20000, 0x10000};
+
+mbc_t mbc_new(uint8_t type) {
+    mbc_t m;
+    memset(&m, 0, sizeof(m));
+    switch (type) {
+    case 0x00:
+    case 0x08:
+    case 0x09:
+        m.type = mbc_none_e;
+        /* Without a controller RAM, if present, is always accessible */
+        m.ram_enable = true;
+        break;
+    case 0x01:
+    case 0x02:
+    case 0x03:
+        m.type = mbc1_e;
+        break;
+    case 0x05:
+    case 0x06:
+        m.type = mbc2_e;
+        break;
+    case 0x0F:
+    case 0x10:
+    case 0x11:
+    case 0x12:
+    case 0x13:
+        m.type = mbc3_e;
+        break;
+    case 0x19:
+    case 0x1A:
+    case 0x1B:
+    case 0x1C:
+    case 0x1D:
+    case 0x1E:
+        m.type = mbc5_e;
+        break;
+    default:
+        PANIC("unsupported cartridge type %#04x", type);
+    }
+    m.rom_bank = 1;
+    return m;
+}
+
+size_t mbc_ram_size(mbc_t *self, uint8_t code) {
+    if (self->type == mbc2_e)
+        return MBC2_RAM_SIZE;
+    if (code >= sizeof(MBC_RAM_SIZES) / sizeof(MBC_RAM_SIZES[0]))
+        return 0;
+    return MBC_RAM_SIZES[code];
+}
+
+void mbc_update(cartridge_t *cart) {
+    mbc_t *m = &cart->mbc;
+    uint16_t bank0 = 0;
+    uint16_t bankx = m->rom_bank;
+    uint8_t ram_bank = m->ram_bank;
+
+    if (m->type == mbc1_e) {
+        bankx |= m->bank_hi << 5;
+        /* Mode 1 also applies the upper bits to the first ROM bank and selects the RAM bank */
+        if (m->mode) {
+            bank0 = m->bank_hi << 5;
+            ram_bank = m->bank_hi;
+        } else {
+            ram_bank = 0;
+        }
+    }
+    cart->rom0 = cart->data + (size_t)(bank0 % cart->rom_banks) * ROM_BANK_SIZE;
+    cart->romx = cart->data + (size_t)(bankx % cart->rom_banks) * ROM_BANK_SIZE;
+
+    cart->sram = NULL;
+    /* Banks 0x08 and up select MBC3 clock registers, which can't be mapped as memory */
+    if (m->ram_enable && m->type != mbc2_e && cart->ram_size != 0 && ram_bank < 0x08)
+        cart->sram = cart->ram + ((size_t)ram_bank * RAM_BANK_SIZE) % cart->ram_size;
+}
+
+bool mbc_write(cartridge_t *cart, uint16_t addr, uint8_t n) {
+    mbc_t *m = &cart->mbc;
+    uint8_t *rom0 = cart->rom0;
+    uint8_t *romx = cart->romx;
+    uint8_t *sram = cart->sram;
+
+    switch (m->type) {
+    case mbc_none_e:
+        return false;
+    case mbc1_e:
+        if (addr <= 0x1FFF)
+            m->ram_enable = (n & 0x0F) == 0x0A;
+        else if (addr <= 0x3FFF)
+            m->rom_bank = (n & 0x1F) == 0 ? 1 : n & 0x1F;
+        else if (addr <= 0x5FFF)
+            m->bank_hi = n & 0x03;
+        else
+            m->mode = n & 0x01;
+        break;
+    case mbc2_e:
+        /* Address bit 8 selects between the two registers in 0x0000-0x3FFF */
+        if (addr >= 0x4000)
+            return false;
+        if (addr & 0x0100)
+            m->rom_bank = (n & 0x0F) == 0 ? 1 : n & 0x0F;
+        else
+            m->ram_enable = (n & 0x0F) == 0x0A;
+        break;
+    case mbc3_e:
+        if (addr <= 0x1FFF)
+            m->ram_enable = (n & 0x0F) == 0x0A;
+        else if (addr <= 0x3FFF)
+            m->rom_bank = (n & 0x7F) == 0 ? 1 : n & 0x7F;
+        else if (addr <= 0x5FFF)
+            m->ram_bank = n;
+        else {
+            /* Writing 0 then 1 latches the clock */
+            if (m->latch == 0x00 && n == 0x01)
+                memcpy(m->rtc_latched, m->rtc, RTC_REG_COUNT);
+            m->latch = n;
+        }
+        break;
+    case mbc5_e:
+        if (addr <= 0x1FFF)
+            m->ram_enable = (n & 0x0F) == 0x0A;
+        else if (addr <= 0x2FFF)
+            m->rom_bank = (m->rom_bank & 0x100) | n;
+        else if (addr <= 0x3FFF)
+            m->rom_bank = (m->rom_bank & 0xFF) | ((n & 0x01) << 8);
+        else if (addr <= 0x5FFF)
+            m->ram_bank = n & 0x0F;
+        break;
+    }
+    mbc_update(cart);
+    return cart->rom0 != rom0 || cart->romx != romx || cart->sram != sram;
+}
@@ -0,0 +1,45 @@
+#ifndef MBC_H
+#define MBC_H
+
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROM_BANK_SIZE 0x4000
+#define RAM_BANK_SIZE 0x2000
+#define MBC2_RAM_SIZE 0x0200
+#define RTC_REG_COUNT 5
+
+#define CART_TYPE_ADDR 0x0147
+#define CART_RAM_SIZE_ADDR 0x0149
+
+typedef enum { mbc_none_e, mbc1_e, mbc2_e, mbc3_e, mbc5_e } mbc_type_t;
+
+/* Bank registers as written by the game, the resulting pointers live in cartridge_t */
+typedef struct {
+    mbc_type_t type;
+    bool ram_enable;
+    /* Bank mapped at 0x4000-0x7FFF, MBC1 only keeps the lower 5 bits here */
+    uint16_t rom_bank;
+    /* External RAM bank, or RTC register 0x08-0x0C on MBC3 */
+    uint8_t ram_bank;
+    /* MBC1 upper ROM bits / RAM bank and banking mode */
+    uint8_t bank_hi;
+    bool mode;
+    /* MBC3 clock registers and the copy latched for reading, the clock is not running */
+    uint8_t rtc[RTC_REG_COUNT];
+    uint8_t rtc_latched[RTC_REG_COUNT];
+    uint8_t latch;
+} mbc_t;
+
+struct cartridge_t;
+
+mbc_t mbc_new(uint8_t type);
+/* Size of the external RAM described by the cartridge header */
+size_t mbc_ram_size(mbc_t *self, uint8_t code);
+/* Handles a write to 0x0000-0x7FFF, returns true when the bank pointers changed */
+bool mbc_write(struct cartridge_t *cart, uint16_t addr, uint8_t n);
+/* Recomputes the bank pointers of cart from its bank registers */
+void mbc_update(struct cartridge_t *cart);
+
+#endif
@@ -0,0 +1,216 @@
+#include "pixel.h"
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define PIXEL_X86
+#include <immintrin.h>
+#endif
+
+bool pixel_scalar_supported() {
+    return true;
+}
+
+void pixel_decode_rows_scalar(const uint8_t *planes, uint8_t *out, size_t rows) {
+    size_t i;
+    uint8_t x;
+    for (i = 0; i < rows; i++) {
+        uint8_t lo = planes[i * 2];
+        uint8_t hi = planes[i * 2 + 1];
+        for (x = 0; x < 8; x++)
+            out[i * 8 + x] = ((lo >> (7 - x)) & 1) | (((hi >> (7 - x)) & 1) << 1);
+    }
+}
+
+void pixel_map_palette_scalar(const uint8_t *idx, uint8_t *out, size_t n,
+                              const uint8_t shades[4]) {
+    size_t i;
+    for (i = 0; i < n; i++)
+        out[i] = shades[idx[i] & 0x03];
+}
+
+void pixel_expand_scalar(const uint8_t *shades, uint32_t *out, size_t n, const uint32_t colors[4]) {
+    size_t i;
+    for (i = 0; i < n; i++)
+        out[i] = colors[shades[i] & 0x03];
+}
+
+#ifdef PIXEL_X86
+/* SSE2 is part of x86-64, only the AVX2 set needs checking */
+bool pixel_sse2_supported() {
+    return true;
+}
+
+/*
+ * Eight rows at a time: every 16-bit lane holds the two planes of a row, one shift per pixel
+ * extracts that pixel of all eight rows, and an 8x8 byte transpose puts them back in row order.
+ */
+void pixel_decode_rows_sse2(const uint8_t *planes, uint8_t *out, size_t rows) {
+    const __m128i plane_bits = _mm_set1_epi16(0x0101);
+    const __m128i index_bits = _mm_set1_epi16(0x0003);
+    size_t i;
+
+    for (i = 0; i + 8 <= rows; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(planes + i * 2));
+        __m128i pairs[4];
+        __m128i lo;
+        __m128i hi;
+        uint8_t x;
+
+        /* pairs[k] holds pixel 2k of rows 0 - 7 followed by pixel 2k + 1 of rows 0 - 7 */
+        for (x = 0; x < 8; x += 2) {
+            __m128i a = _mm_and_si128(_mm_srl_epi16(v, _mm_cvtsi32_si128(7 - x)), plane_bits);
+            __m128i b = _mm_and_si128(_mm_srl_epi16(v, _mm_cvtsi32_si128(6 - x)), plane_bits);
+            a = _mm_and_si128(_mm_or_si128(a, _mm_srli_epi16(a, 7)), index_bits);
+            b = _mm_and_si128(_mm_or_si128(b, _mm_srli_epi16(b, 7)), index_bits);
+            pairs[x / 2] = _mm_packus_epi16(a, b);
+        }
+        for (x = 0; x < 4; x++)
+            pairs[x] = _mm_unpacklo_epi8(pairs[x], _mm_srli_si128(pairs[x], 8));
+        /* Pixels 0 - 3 and 4 - 7 of rows 0 - 3, then of rows 4 - 7 */
+        lo = _mm_unpacklo_epi16(pairs[0], pairs[1]);
+        hi = _mm_unpacklo_epi16(pairs[2], pairs[3]);
+        _mm_storeu_si128((__m128i *)(out + i * 8), _mm_unpacklo_epi32(lo, hi));
+        _mm_storeu_si128((__m128i *)(out + i * 8 + 16), _mm_unpackhi_epi32(lo, hi));
+        lo = _mm_unpackhi_epi16(pairs[0], pairs[1]);
+        hi = _mm_unpackhi_epi16(pairs[2], pairs[3]);
+        _mm_storeu_si128((__m128i *)(out + i * 8 + 32), _mm_unpacklo_epi32(lo, hi));
+        _mm_storeu_si128((__m128i *)(out + i * 8 + 48), _mm_unpackhi_epi32(lo, hi));
+    }
+    pixel_decode_rows_scalar(planes + i * 2, out + i * 8, rows - i);
+}
+
+/* Sixteen pixels at a time, every index selects its shade through a compare mask */
+void pixel_map_palette_sse2(const uint8_t *idx, uint8_t *out, size_t n,
+                            const uint8_t shades[4]) {
+    const __m128i index_bits = _mm_set1_epi8(0x03);
+    __m128i indices[4];
+    __m128i values[4];
+    size_t i;
+
+    for (i = 0; i < 4; i++) {
+        indices[i] = _mm_set1_epi8(i);
+        values[i] = _mm_set1_epi8(shades[i]);
+    }
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(idx + i)), index_bits);
+        __m128i r = _mm_and_si128(_mm_cmpeq_epi8(v, indices[0]), values[0]);
+        r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(v, indices[1]), values[1]));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(v, indices[2]), values[2]));
+        r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi8(v, indices[3]), values[3]));
+        _mm_storeu_si128((__m128i *)(out + i), r);
+    }
+    pixel_map_palette_scalar(idx + i, out + i, n - i, shades);
+}
+
+/* Selects colors[k] in every 32-bit lane of w holding k */
+__m128i pixel_select_sse2(__m128i w, const __m128i *indices, const __m128i *values) {
+    __m128i r = _mm_and_si128(_mm_cmpeq_epi32(w, indices[0]), values[0]);
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi32(w, indices[1]), values[1]));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi32(w, indices[2]), values[2]));
+    return _mm_or_si128(r, _mm_and_si128(_mm_cmpeq_epi32(w, indices[3]), values[3]));
+}
+
+/* Sixteen pixels at a time, widened to four vectors of 32-bit lanes and selected like shades */
+void pixel_expand_sse2(const uint8_t *shades, uint32_t *out, size_t n, const uint32_t colors[4]) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i index_bits = _mm_set1_epi8(0x03);
+    __m128i indices[4];
+    __m128i values[4];
+    size_t i;
+
+    for (i = 0; i < 4; i++) {
+        indices[i] = _mm_set1_epi32(i);
+        values[i] = _mm_set1_epi32((int)colors[i]);
+    }
+    for (i = 0; i + 16 <= n; i += 16) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(shades + i)), index_bits);
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        _mm_storeu_si128((__m128i *)(out + i),
+                         pixel_select_sse2(_mm_unpacklo_epi16(lo, zero), indices, values));
+        _mm_storeu_si128((__m128i *)(out + i + 4),
+                         pixel_select_sse2(_mm_unpackhi_epi16(lo, zero), indices, values));
+        _mm_storeu_si128((__m128i *)(out + i + 8),
+                         pixel_select_sse2(_mm_unpacklo_epi16(hi, zero), indices, values));
+        _mm_storeu_si128((__m128i *)(out + i + 12),
+                         pixel_select_sse2(_mm_unpackhi_epi16(hi, zero), indices, values));
+    }
+    pixel_expand_scalar(shades + i, out + i, n - i, colors);
+}
+
+bool pixel_avx2_supported() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2");
+}
+
+/* PDEP spreads the bits of each plane into the low bit of eight bytes, last pixel first */
+__attribute__((target("bmi2"))) void pixel_decode_rows_avx2(const uint8_t *planes, uint8_t *out,
+                                                              size_t rows) {
+    const uint64_t spread = ((uint64_t)0x01010101 << 32) | 0x01010101;
+    size_t i;
+    for (i = 0; i < rows; i++) {
+        uint64_t row = _pdep_u64(planes[i * 2], spread);
+        row |= _pdep_u64(planes[i * 2 + 1], spread) << 1;
+        row = __builtin_bswap64(row);
+        memcpy(out + i * 8, &row, 8);
+    }
+}
+
+/* Thirty-two pixels at a time, the palette is a byte shuffle table */
+__attribute__((target("avx2"))) void pixel_map_palette_avx2(const uint8_t *idx, uint8_t *out,
+                                                              size_t n, const uint8_t shades[4]) {
+    const char s0 = shades[0];
+    const char s1 = shades[1];
+    const char s2 = shades[2];
+    const char s3 = shades[3];
+    const __m256i index_bits = _mm256_set1_epi8(0x03);
+    /* VPSHUFB looks up each 128-bit half on its own, both get the four shades */
+    const __m256i table = _mm256_setr_epi8(s0, s1, s2, s3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, s0,
+                                           s1, s2, s3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    size_t i;
+
+    for (i = 0; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(idx + i)), index_bits);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(table, v));
+    }
+    pixel_map_palette_sse2(idx + i, out + i, n - i, shades);
+}
+
+/* Eight pixels per permute, the colours are a table of 32-bit lanes */
+__attribute__((target("avx2"))) void pixel_expand_avx2(const uint8_t *shades, uint32_t *out,
+                                                         size_t n, const uint32_t colors[4]) {
+    const __m256i index_bits = _mm256_set1_epi32(0x03);
+    const __m256i table = _mm256_setr_epi32(colors[0], colors[1], colors[2], colors[3], colors[0],
+                                            colors[1], colors[2], colors[3]);
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(shades + i)));
+        v = _mm256_and_si256(v, index_bits);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permutevar8x32_epi32(table, v));
+    }
+    pixel_expand_scalar(shades + i, out + i, n - i, colors);
+}
+#endif
+
+const pixel_kernels PIXEL_IMPLS[] = {
+    {"scalar", pixel_scalar_supported, pixel_decode_rows_scalar, pixel_map_palette_scalar,
+     pixel_expand_scalar},
+#ifdef PIXEL_X86
+    {"sse2", pixel_sse2_supported, pixel_decode_rows_sse2, pixel_map_palette_sse2,
+     pixel_expand_sse2},
+    {"avx2", pixel_avx2_supported, pixel_decode_rows_avx2, pixel_map_palette_avx2,
+     pixel_expand_avx2},
+#endif
+};
+const uint8_t PIXEL_IMPL_COUNT = sizeof(PIXEL_IMPLS) / sizeof(PIXEL_IMPLS[0]);
+
+pixel_kernels PIXEL_KERNELS = {"scalar", pixel_scalar_supported, pixel_decode_rows_scalar,
+                               pixel_map_palette_scalar, pixel_expand_scalar};
+
+void pixel_init() {
+    uint8_t i;
+    for (i = 0; i < PIXEL_IMPL_COUNT; i++)
+        if (PIXEL_IMPLS[i].supported())
+            PIXEL_KERNELS = PIXEL_IMPLS[i];
+}
@@ -0,0 +1,31 @@
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include "utils.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Kernels turning tile data into pixels, one set per instruction set. Every set produces the
+ * same output, the best one the host supports is picked at runtime by pixel_init.
+ */
+typedef struct {
+    const char *name;
+    bool (*supported)();
+    /* Decodes rows of tile data, a low and a high bit plane each, to 8 colour indices per row */
+    void (*decode_rows)(const uint8_t *planes, uint8_t *out, size_t rows);
+    /* Maps n colour indices to shades through the table of a palette such as BGP */
+    void (*map_palette)(const uint8_t *idx, uint8_t *out, size_t n, const uint8_t shades[4]);
+    /* Expands n shades to the 32-bit colours of the frontend */
+    void (*expand)(const uint8_t *shades, uint32_t *out, size_t n, const uint32_t colors[4]);
+} pixel_kernels;
+
+/* Every set in order of preference, scalar first */
+extern const pixel_kernels PIXEL_IMPLS[];
+extern const uint8_t PIXEL_IMPL_COUNT;
+/* The selected set, scalar until pixel_init runs */
+extern pixel_kernels PIXEL_KERNELS;
+
+void pixel_init();
+
+#endif
@@ -1,293 +1,324 @@
 #include "ppu.h"
-#include "SDL_render.h"
-
-#define HEIGHT 144
-#define WIDTH 160
-
-#define CLOCKS_PER_HBLANK 51
-#define CLOCKS_PER_DRAW 43
-#define CLOCKS_PER_OAM 20
-#define CLOCKS_PER_VBLANK (CLOCKS_PER_OAM + CLOCKS_PER_DRAW + CLOCKS_PER_HBLANK)
-
-/* TODO: SDL_SetPaletteColor doesn't work */
-const SDL_Color GB_PALETTE[3] = {
-    {0xFF, 0xFF, 0xFF, 0xFF},
-    {0xCC, 0xCC, 0xCC, 0xFF},
-    {0x77, 0x77, 0x77, 0xFF},
-};
+#include "pixel.h"
+#include "trace.h"
+#include <string.h>
+
+void ppu_map_registers(ppu *ppu, bus *bus) {
+    ppu->bus = bus;
+    ppu->lcdc = (void *)bus_read_ptr(bus, 0xFF40);
+    ppu->lcds = (void *)bus_read_ptr(bus, 0xFF41);
+    ppu->scroll_y = (void *)bus_read_ptr(bus, 0xFF42);
+    ppu->scroll_x = (void *)bus_read_ptr(bus, 0xFF43);
+    ppu->ly = (void *)bus_read_ptr(bus, 0xFF44);
+    ppu->lyc = (void *)bus_read_ptr(bus, 0xFF45);
+    ppu->window_y = (void *)bus_read_ptr(bus, 0xFF4A);
+    ppu->window_x = (void *)bus_read_ptr(bus, 0xFF4B);
+    ppu->int_flags = bus_read_ptr(bus, IO_START + IO_IF_OFF);
+    ppu->objs = (void *)bus_read_ptr(bus, SAT_START);
+}
 
 ppu ppu_new(bus *bus) {
     ppu ppu;
-    ppu.bus = bus;
-    ppu.lcdc = (void *)bus_read_ptr(bus, 0xFF40);
-    ppu.lcds = (void *)bus_read_ptr(bus, 0xFF41);
-    ppu.scroll_y = (void *)bus_read_ptr(bus, 0xFF42);
-    ppu.scroll_x = (void *)bus_read_ptr(bus, 0xFF43);
-    ppu.ly = (void *)bus_read_ptr(bus, 0xFF44);
-    ppu.lyc = (void *)bus_read_ptr(bus, 0xFF45);
-    ppu.palette = (void *)bus_read_ptr(bus, 0xFF47);
-    ppu.window_y = (void *)bus_read_ptr(bus, 0xFF4A);
-    ppu.window_x = (void *)bus_read_ptr(bus, 0xFF4B);
-    ppu.objs = (void *)bus_read_ptr(bus, SAT_START);
-#ifndef TESTING
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
-        sdl_panic();
-    if (SDL_CreateWindowAndRenderer(WIDTH, HEIGHT, 0, &ppu.window, &ppu.renderer))
-        sdl_panic();
+    ppu_map_registers(&ppu, bus);
+    /* Every line starts with the OAM scan, the first transition is due after CLOCKS_PER_OAM */
+    ppu.lcds->state = oam_state_e;
+    ppu.line_obj_count = 0;
+    memset(ppu.framebuffer, 0, sizeof(ppu.framebuffer));
+#ifdef PPU_FIFO
+    memset(&ppu.fifo, 0, sizeof(ppu.fifo));
 #endif
-    ppu.clocks = 0;
-    ppu.mode_clocks = 0;
+    ppu.clocks = CLOCKS_PER_OAM;
+    ppu.frames = 0;
+    ppu.render_ratio = 1;
+    ppu.render = true;
 
     return ppu;
 }
 
-uint8_t ppu_get_color(ppu *ppu, uint16_t addr, uint8_t idx) {
-    struct palette *pal = (void *)bus_read_ptr(ppu->bus, addr);
-    uint8_t res;
-    switch (idx) {
-    case 0:
-        res = pal->index_0;
-        break;
-    case 1:
-        res = pal->index_1;
-        break;
-    case 2:
-        res = pal->index_2;
-        break;
-    case 3:
-        res = pal->index_3;
-        break;
-    default:
-        res = 0; /* Ignore in case of panic */
-        PANIC("invalid color index");
-    }
-    return res;
+void ppu_put_pixel(ppu *ppu, uint8_t x, uint8_t y, uint8_t color) {
+    ppu->framebuffer[y][x] = color;
 }
 
-void ppu_render_obj(ppu *ppu) {
-    bool tall = ppu->lcdc->obj_size == tall_obj_size_e;
+/*
+ * Takes the first OBJS_PER_LINE sprites in OAM order that cover the line, like the hardware.
+ * Sprites further left are drawn on top, the one first in OAM wins between equal positions.
+ */
+void ppu_scan_oam(ppu *ppu) {
+    uint8_t height = ppu->lcdc->obj_size == tall_obj_size_e ? 16 : 8;
+    uint8_t ly = *ppu->ly;
+    uint64_t found = 0;
+    uint16_t y;
     uint8_t i;
 
-    for (i = 0; i < 40; i++) {
-        struct sprite sprite = ppu->objs[i];
-        uint8_t ysize = (tall) ? 16 : 8;
-
-        if ((*ppu->ly >= sprite.ypos) && (*ppu->ly < (sprite.ypos + ysize))) {
-            int8_t line = *ppu->ly - sprite.ypos;
-            uint16_t obj_addr;
-            uint8_t obj_a;
-            uint8_t obj_b;
-            uint8_t obj_pixel;
-
-            if (sprite.attrs.yflip) {
-                line -= ysize;
-                line *= -1;
-            }
-
-            line *= 2;
-
-            obj_addr = (VRAM_START + (sprite.tile_idx * 16)) + line;
-            obj_a = bus_read(ppu->bus, obj_addr);
-            obj_b = bus_read(ppu->bus, obj_addr + 1);
-
-            for (obj_pixel = 7; obj_pixel >= 0; obj_pixel--) {
-                int8_t color_bit = obj_pixel;
-                int8_t color_idx = obj_pixel;
-                uint16_t palette_addr;
-                uint8_t color;
-                int8_t x_pixel;
-                uint8_t pixel;
-
-                if (sprite.attrs.xflip) {
-                    color_bit -= 7;
-                    color_bit *= -1;
-                }
-
-                color_idx = (obj_b >> color_bit) & 0x01;
-                color_idx <<= 1;
-                color_idx |= (obj_a >> color_bit) & 0x01;
-
-                palette_addr = (sprite.attrs.palette == obp0_palette_e) ? 0xFF48 : 0xFF49;
+    /* Sprites covering ly start on it or up to height - 1 lines above */
+    for (y = ly + OBJ_Y_OFFSET - height + 1; y <= ly + OBJ_Y_OFFSET && y < 0x100; y++)
+        found |= ppu->bus->objs_by_y[y];
 
-                color = ppu_get_color(ppu, palette_addr, color_idx);
+    ppu->line_obj_count = 0;
+    for (i = 0; found != 0 && ppu->line_obj_count < OBJS_PER_LINE; i++, found >>= 1) {
+        uint8_t xpos = ppu->objs[i].xpos;
+        uint8_t j;
 
-                if (color == 0) {
-                    continue;
-                }
-
-                x_pixel = 0 - obj_pixel;
-                x_pixel += 7;
+        if (!(found & 1))
+            continue;
+        for (j = ppu->line_obj_count; j > 0 && ppu->objs[ppu->line_objs[j - 1]].xpos > xpos; j--)
+            ppu->line_objs[j] = ppu->line_objs[j - 1];
+        ppu->line_objs[j] = i;
+        ppu->line_obj_count++;
+    }
+}
 
-                pixel = x_pixel + sprite.xpos;
-                if ((*ppu->ly < 0) || (*ppu->ly > 143) || (pixel < 0) || (pixel > 159)) {
-                    continue;
-                }
-                SDL_SetRenderDrawColor(ppu->renderer, GB_PALETTE[color].r, GB_PALETTE[color].g,
-                                       GB_PALETTE[color].b, GB_PALETTE[color].a);
-                SDL_RenderDrawPoint(ppu->renderer, pixel, *ppu->ly);
-            }
+#ifndef PPU_FIFO
+/* Draws the sprites of the last OAM scan over pixels start to end - 1 */
+void ppu_render_obj(ppu *ppu, uint8_t start, uint8_t end) {
+    uint8_t height = ppu->lcdc->obj_size == tall_obj_size_e ? 16 : 8;
+    uint8_t ly = *ppu->ly;
+    uint8_t i = ppu->line_obj_count;
+
+    if (ly >= HEIGHT)
+        return;
+    /* Lowest priority first, so higher ones are drawn over it */
+    while (i-- > 0) {
+        struct sprite sprite = ppu->objs[ppu->line_objs[i]];
+        int16_t line = ly + OBJ_Y_OFFSET - sprite.ypos;
+        int16_t left = sprite.xpos - OBJ_X_OFFSET;
+        /* Tall sprites ignore the lowest bit of their tile number */
+        uint16_t tile = height == 16 ? sprite.tile_idx & 0xFE : sprite.tile_idx;
+        const uint8_t *shades = ppu->bus->palettes[sprite.attrs.palette == obp0_palette_e
+                                                        ? PALETTE_OBP0
+                                                        : PALETTE_OBP1];
+        const uint8_t *row;
+        uint8_t idx[8];
+        uint8_t colors[8];
+        uint8_t x;
+
+        /* Still checked, LCDC may have changed the sprite size since the scan */
+        if (line < 0 || line >= height)
+            continue;
+        if (sprite.attrs.yflip)
+            line = height - 1 - line;
+        /* Rows past the first tile continue into the following one */
+        row = ppu->bus->tiles[tile + line / 8][line % 8];
+        for (x = 0; x < 8; x++)
+            idx[x] = row[sprite.attrs.xflip ? 7 - x : x];
+        PIXEL_KERNELS.map_palette(idx, colors, 8, shades);
+
+        for (x = 0; x < 8; x++) {
+            /* Colour index 0 is transparent whatever the palette maps it to */
+            if (idx[x] == 0 || left + x < start || left + x >= end)
+                continue;
+            ppu_put_pixel(ppu, left + x, ly, colors[x]);
         }
     }
 }
 
-void ppu_render_bg(ppu *ppu) {
-    bool use_window = false;
-    bool signed_tile;
-    uint16_t tile_mem_idx;
-    uint16_t bg_mem_idx;
-    uint8_t ypos;
-    uint16_t tile_row;
-    uint8_t pixel;
+#endif
+
+/* Index into the decoded tiles of tile number n of the tile data selected in LCDC */
+uint16_t ppu_tile_index(ppu *ppu, uint8_t n) {
+    /* Numbers are unsigned from 0x8000 or signed from 0x9000 */
+    if (ppu->lcdc->wdata == sec_wdata_e)
+        return n;
+    return 256 + (int8_t)n;
+}
 
-    if (ppu->lcdc->window_enable && ppu->window_y <= ppu->ly)
-        use_window = true;
-    if (ppu->lcdc->wdata == first_wdata_e) {
-        tile_mem_idx = 0x8800;
-        signed_tile = false;
-    } else {
-        tile_mem_idx = 0x8000;
-        signed_tile = true;
+#ifndef PPU_FIFO
+/* Copies the colour indices of line y of count tiles of map, from tile column column onwards */
+void ppu_fetch_tiles(ppu *ppu, uint8_t *line, uint16_t map, uint8_t column, uint8_t y,
+                     uint8_t count) {
+    const uint8_t *tile_nums = &ppu->bus->vram[map + (y / 8) * 32];
+    uint8_t i;
+    for (i = 0; i < count; i++) {
+        uint8_t tile_num = tile_nums[(column + i) % 32];
+        memcpy(&line[i * 8], ppu->bus->tiles[ppu_tile_index(ppu, tile_num)][y % 8], 8);
     }
+}
 
-    /* Determine which bank to use */
-    if (!use_window) {
-        if (ppu->lcdc->bgmap == first_bgmap_e)
-            bg_mem_idx = 0x9800;
-        else
-            bg_mem_idx = 0x9C00;
-    } else {
-        if (ppu->lcdc->wmap == first_wmap_e)
-            bg_mem_idx = 0x9800;
-        else
-            bg_mem_idx = 0x9C00;
+/*
+ * Gathers the colour indices of the whole line from the tile cache a tile at a time, then maps
+ * pixels start to end - 1 through BGP in one go.
+ */
+void ppu_render_bg(ppu *ppu, uint8_t start, uint8_t end) {
+    /* Whole tiles are copied, so both lines have room for a partial tile at either end */
+    uint8_t line[WIDTH + 16];
+    uint8_t window_line[WIDTH + 16];
+    uint8_t ly = *ppu->ly;
+    bool use_window = ppu->lcdc->window_enable && *ppu->window_y <= ly;
+    /* The window starts at window_x - 7 and covers the rest of the line */
+    int16_t window_start = use_window ? *ppu->window_x - 7 : WIDTH;
+    uint16_t bg_map = (ppu->lcdc->bgmap == first_bgmap_e ? 0x9800 : 0x9C00) - VRAM_START;
+    uint16_t window_map = (ppu->lcdc->wmap == first_wmap_e ? 0x9800 : 0x9C00) - VRAM_START;
+    /* Screen pixel x is line[fine + x] */
+    uint8_t fine = *ppu->scroll_x % 8;
+    uint8_t bg_end = window_start < 0 ? 0 : window_start < WIDTH ? window_start : WIDTH;
+
+    if (ly >= HEIGHT)
+        return;
+    ppu_fetch_tiles(ppu, line, bg_map, *ppu->scroll_x / 8, ly + *ppu->scroll_y,
+                    (fine + bg_end + 7) / 8);
+    if (bg_end < WIDTH) {
+        /* Window pixel x is screen pixel window_start + x, and is left of the screen below 0 */
+        ppu_fetch_tiles(ppu, window_line, window_map, 0, ly - *ppu->window_y,
+                        (WIDTH - window_start + 7) / 8);
+        memcpy(&line[fine + bg_end], &window_line[bg_end - window_start], WIDTH - bg_end);
     }
+    PIXEL_KERNELS.map_palette(&line[fine + start], &ppu->framebuffer[ly][start], end - start,
+                              ppu->bus->palettes[PALETTE_BGP]);
+}
 
-    if (!use_window)
-        ypos = *ppu->scroll_y + *ppu->ly;
+/* Renders pixels start to end - 1 of the line with the current register values */
+void ppu_draw_segment(ppu *ppu, uint8_t start, uint8_t end) {
+    if (*ppu->ly >= HEIGHT)
+        return;
+    if (ppu->lcdc->bg_win_enable)
+        ppu_render_bg(ppu, start, end);
     else
-        ypos = *ppu->ly - *ppu->window_y;
-
-    tile_row = (ypos / 8) * 32;
-
-    for (pixel = 0; pixel < WIDTH; pixel++) {
-        uint8_t xpos;
-        uint16_t tile_column;
-        int16_t tile_num;
-        uint16_t tile_addr;
-        uint16_t tile_loc;
-        uint8_t line;
-        uint8_t tile_a;
-        uint8_t tile_b;
-        int8_t color_idx;
-        uint8_t palette_idx;
-        uint8_t color;
+        memset(&ppu->framebuffer[*ppu->ly][start], 0, end - start);
+    if (ppu->lcdc->obj_enable)
+        ppu_render_obj(ppu, start, end);
+}
 
-        if ((use_window) && (pixel >= *ppu->window_x))
-            xpos = pixel - *ppu->window_x;
-        else
-            xpos = pixel + *ppu->scroll_x;
+/* Pixel a register write at when, during the draw period of the line, takes effect from */
+uint8_t ppu_write_pixel(ppu *ppu, uintptr_t when) {
+    uintptr_t dots = (when - (ppu->clocks - CLOCKS_PER_DRAW)) * DOTS_PER_CLOCK;
+    if (dots < DRAW_FETCH_DOTS)
+        return 0;
+    return dots - DRAW_FETCH_DOTS < WIDTH ? dots - DRAW_FETCH_DOTS : WIDTH;
+}
 
-        tile_column = xpos / 8;
-        tile_addr = bg_mem_idx + tile_row + tile_column;
+/*
+ * Renders the line in segments, one per register write logged while it was drawn. The registers
+ * are first rewound to their values at the start of the line, then every write is applied again
+ * at the pixel it was made at.
+ */
+void ppu_draw_scanline(ppu *ppu) {
+    bus *bus = ppu->bus;
+    uint8_t start = 0;
+    uint8_t i;
 
-        if (signed_tile) {
-            tile_num = (int16_t)bus_read(ppu->bus, tile_addr);
+    for (i = bus->raster_count; i-- > 0;)
+        bus->io[bus->raster_log[i].reg] = bus->raster_log[i].old;
+    if (bus->raster_count > 0)
+        bus_decode_palettes(bus);
+    for (i = 0; i < bus->raster_count; i++) {
+        const raster_write_t *entry = &bus->raster_log[i];
+        uint8_t end = ppu_write_pixel(ppu, entry->when);
+
+        if (end > start) {
+            ppu_draw_segment(ppu, start, end);
+            start = end;
         }
+        bus->io[entry->reg] = entry->value;
+        bus_decode_palettes(bus);
+    }
+    if (start < WIDTH)
+        ppu_draw_segment(ppu, start, WIDTH);
+    bus->raster_count = 0;
+}
 
-        tile_loc = tile_mem_idx;
-
-        if (signed_tile)
-            tile_loc += (tile_num + 128) * 16;
-        else
-            tile_loc += tile_num * 16;
-
-        line = ypos % 8;
-        line *= 2;
-
-        tile_a = bus_read(ppu->bus, tile_loc + line);
-        tile_b = bus_read(ppu->bus, tile_loc + line + 1);
-
-        color_idx = xpos % 8;
-        color_idx -= 7;
-        color_idx *= -1;
-
-        palette_idx = (tile_b >> color_idx) & 0x01;
-        palette_idx <<= 1;
-        palette_idx |= (tile_a >> color_idx) & 0x01;
-
-        color = ppu_get_color(ppu, 0xFF47, palette_idx);
+#endif
 
-        if ((*ppu->ly < 0) || (*ppu->ly > 143) || (pixel < 0) || (pixel > 159)) {
-            continue;
-        }
-        SDL_SetRenderDrawColor(ppu->renderer, GB_PALETTE[color].r, GB_PALETTE[color].g,
-                               GB_PALETTE[color].b, GB_PALETTE[color].a);
-        SDL_RenderDrawPoint(ppu->renderer, pixel, pixel);
+/* Moves to state, requesting the STAT interrupt if it is enabled for the new mode */
+void ppu_enter_state(ppu *ppu, uint8_t state) {
+    bool stat;
+    ppu->lcds->state = state;
+    TRACE(TRACE_PPU, trace_ppu_state_e, *ppu->ly, 0, state);
+    switch (state) {
+    case hblank_state_e:
+        stat = ppu->lcds->mode0_int;
+        break;
+    case vblank_state_e:
+        *ppu->int_flags |= INT_VBLANK;
+        stat = ppu->lcds->mode1_int;
+        break;
+    case oam_state_e:
+        stat = ppu->lcds->mode2_int;
+        break;
+    default:
+        stat = false;
+        break;
     }
+    if (stat)
+        *ppu->int_flags |= INT_STAT;
 }
 
-void ppu_draw_scanline(ppu *ppu) {
-    /* LOG("PPU", "Drawing scanline"); */
-    /* LOG("PPU", "BG Enabled: %d", ppu->lcdc->bg_win_enable); */
-    if (ppu->lcdc->bg_win_enable)
-        ppu_render_bg(ppu);
-    /* LOG("PPU", "OBJ Enabled: %d", ppu->lcdc->obj_enable); */
-    if (ppu->lcdc->obj_enable)
-        ppu_render_obj(ppu);
+/* Updates the coincidence flag after LY changed, requesting the STAT interrupt on a match */
+void ppu_compare_ly(ppu *ppu) {
+    ppu->lcds->lyc_eq_ly = *ppu->ly == *ppu->lyc;
+    if (ppu->lcds->lyc_eq_ly && ppu->lcds->lyc_eq_ly_int)
+        *ppu->int_flags |= INT_STAT;
 }
 
+/* Performs the lcd state transition that is due now and returns the clocks until the next one */
 uintptr_t ppu_clock(ppu *ppu) {
-    uintptr_t old_clocks = ppu->clocks++;
-    ppu->mode_clocks++;
+    uintptr_t next = 0;
     switch (ppu->lcds->state) {
     case oam_state_e:
-        if (ppu->mode_clocks >= CLOCKS_PER_OAM) {
-            ppu->mode_clocks %= CLOCKS_PER_OAM;
-            ppu->lcds->state = draw_state_e;
-            /* LOG("PPU", "Switched to draw state from oam"); */
-        }
+#ifdef PPU_FIFO
+        /* Sprites lengthen the draw state, they are needed even when nothing is drawn */
+        ppu_scan_oam(ppu);
+        ppu_enter_state(ppu, draw_state_e);
+        ppu_fifo_start_line(ppu);
+        next = 1;
+#else
+        if (ppu->render)
+            ppu_scan_oam(ppu);
+        ppu_enter_state(ppu, draw_state_e);
+        next = CLOCKS_PER_DRAW;
+#endif
         break;
     case hblank_state_e:
-        if (ppu->mode_clocks >= CLOCKS_PER_HBLANK) {
-            ppu->mode_clocks %= CLOCKS_PER_HBLANK;
-            (*ppu->ly)++;
-            if (*ppu->ly == HEIGHT - 1) {
-                ppu->lcds->state = vblank_state_e;
-                /* LOG("PPU", "Switched to vblank state from hblank"); */
-                SDL_RenderPresent(ppu->renderer);
-            } else {
-                ppu->lcds->state = oam_state_e;
-                /* LOG("PPU", "Switched to oam state from hblank"); */
-            }
+        (*ppu->ly)++;
+        ppu_compare_ly(ppu);
+        if (*ppu->ly == HEIGHT) {
+            ppu_enter_state(ppu, vblank_state_e);
+            ppu->frames++;
+            next = CLOCKS_PER_VBLANK;
+        } else {
+            ppu_enter_state(ppu, oam_state_e);
+            next = CLOCKS_PER_OAM;
         }
         break;
     case vblank_state_e:
-        if (ppu->mode_clocks >= CLOCKS_PER_VBLANK) {
-            ppu->mode_clocks %= CLOCKS_PER_VBLANK;
-            (*ppu->ly)++;
-
-            if (*ppu->ly > 153) {
-                ppu->lcds->state = oam_state_e;
-                *ppu->ly = 0;
-                /* LOG("PPU", "Switched to oam state from vblank"); */
-            }
+        (*ppu->ly)++;
+        if (*ppu->ly > LAST_LINE) {
+            *ppu->ly = 0;
+            ppu->render = ppu->render_ratio != 0 && ppu->frames % ppu->render_ratio == 0;
+#ifdef PPU_FIFO
+            ppu_fifo_start_frame(ppu);
+#endif
+            ppu_enter_state(ppu, oam_state_e);
+            next = CLOCKS_PER_OAM;
+        } else {
+            next = CLOCKS_PER_VBLANK;
         }
+        ppu_compare_ly(ppu);
         break;
     case draw_state_e:
-        if (ppu->mode_clocks >= CLOCKS_PER_DRAW) {
-            ppu->mode_clocks %= CLOCKS_PER_DRAW;
-            ppu->lcds->state = hblank_state_e;
-            /* LOG("PPU", "Switched to hblank state from draw"); */
-
-            ppu_draw_scanline(ppu);
+#ifdef PPU_FIFO
+        /* The line takes as long as the FIFO needs, HBlank makes up the rest */
+        if (ppu_fifo_step(ppu)) {
+            next = 1;
+            break;
         }
+        ppu_enter_state(ppu, hblank_state_e);
+        next = CLOCKS_PER_VBLANK - CLOCKS_PER_OAM -
+               (ppu->fifo.dots + DOTS_PER_CLOCK - 1) / DOTS_PER_CLOCK;
+#else
+        ppu_enter_state(ppu, hblank_state_e);
+        /* The registers already hold their last values, the log is only needed for drawing */
+        if (ppu->render)
+            ppu_draw_scanline(ppu);
+        else
+            ppu->bus->raster_count = 0;
+        next = CLOCKS_PER_HBLANK;
+#endif
         break;
     }
-    return ppu->clocks - old_clocks;
+    ppu->clocks += next;
+    return next;
 }
 
 void ppu_free(ppu ppu) {
-    SDL_DestroyRenderer(ppu.renderer);
-    SDL_DestroyWindow(ppu.window);
-    SDL_Quit();
+    (void)ppu;
 }
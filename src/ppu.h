@@ -3,7 +3,61 @@
 
 #include "bus.h"
 #include "utils.h"
-#include <SDL.h>
+
+#define HEIGHT 144
+#define WIDTH 160
+#define LAST_LINE 153
+#define OBJS_PER_LINE 10
+#define OBJ_Y_OFFSET 16
+#define OBJ_X_OFFSET 8
+
+#define CLOCKS_PER_HBLANK 51
+#define CLOCKS_PER_DRAW 43
+#define CLOCKS_PER_OAM 20
+#define DOTS_PER_CLOCK 4
+/* Dots into the draw period before the first pixel is output */
+#define DRAW_FETCH_DOTS 12
+#ifdef PPU_FIFO
+#define PPU_ENGINE "fifo"
+#else
+#define PPU_ENGINE "scanline"
+#endif
+/* Also the length of every line */
+#define CLOCKS_PER_VBLANK (CLOCKS_PER_OAM + CLOCKS_PER_DRAW + CLOCKS_PER_HBLANK)
+
+#ifdef PPU_FIFO
+/* The pixel FIFO and its fetcher, drawing the current line one dot at a time */
+typedef struct {
+    /* Background colour indices waiting to be shifted out, bg[bg_head] first */
+    uint8_t bg[16];
+    uint8_t bg_head;
+    uint8_t bg_count;
+    /* Sprite colour indices, 0 for none, and attributes of the next 8 pixels */
+    uint8_t obj[8];
+    uint8_t obj_attrs[8];
+    uint8_t obj_head;
+    /* Fetcher step, tile column and the tile number and row it fetched */
+    uint8_t step;
+    uint8_t fetch_x;
+    uint8_t tile_num;
+    uint8_t row[8];
+    /* Next pixel of the line and pixels still to be dropped for SCX or WX */
+    uint8_t lx;
+    uint8_t discard;
+    /* Dots left before the first fetch and of the sprite fetch in progress */
+    uint8_t stall;
+    uint8_t obj_dots;
+    /* Next entry of line_objs to fetch */
+    uint8_t next_obj;
+    bool in_window;
+    /* Dots since the start of the draw state */
+    uint16_t dots;
+    /* Window line drawn next, counting only lines the window was drawn on */
+    uint8_t window_line;
+    /* Whether LY matched WY earlier in this frame */
+    bool window_y_hit;
+} ppu_fifo_t;
+#endif
 
 typedef struct {
     bus *bus;
@@ -38,56 +92,67 @@ typedef struct {
         uint8_t lyc_eq_ly_int : 1;
         uint8_t _ : 1;
     } * lcds;
-    struct __attribute((packed)) palette {
-        uint8_t index_0 : 2;
-        uint8_t index_1 : 2;
-        uint8_t index_2 : 2;
-        uint8_t index_3 : 2;
-    } * palette;
     uint8_t *scroll_y;
     uint8_t *scroll_x;
     uint8_t *ly;
     uint8_t *lyc;
     uint8_t *window_y;
     uint8_t *window_x;
+    /* IF, VBlank and STAT interrupts are requested here */
+    uint8_t *int_flags;
+    /* OAM entries, positions are offset so sprites can be partly off the top left */
     struct __attribute((packed)) sprite {
-#if BIG_ENDIAN
-        uint8_t ypos;
-        uint8_t xpos;
+        uint8_t ypos; /* Top line + OBJ_Y_OFFSET */
+        uint8_t xpos; /* Left column + OBJ_X_OFFSET */
         uint8_t tile_idx;
         struct __attribute((packed)) {
-            uint8_t bg_over : 1;
-            uint8_t yflip : 1;
-            uint8_t xflip : 1;
-            enum {
-                obp0_palette_e, /* 0xFF48 */
-                obp1_palette_e  /* 0xFF49 */
-            } palette : 1;
             uint8_t _ : 4;
-        } attrs;
-#else
-        struct __attribute((packed)) {
-            uint8_t bg_over : 1;
-            uint8_t yflip : 1;
-            uint8_t xflip : 1;
             enum {
                 obp0_palette_e, /* 0xFF48 */
                 obp1_palette_e  /* 0xFF49 */
             } palette : 1;
-            uint8_t _ : 4;
+            uint8_t xflip : 1;
+            uint8_t yflip : 1;
+            uint8_t bg_over : 1;
         } attrs;
-        uint8_t tile_idx;
-        uint8_t xpos;
-        uint8_t ypos;
-#endif
     } * objs;
-    SDL_Window *window;
-    SDL_Renderer *renderer;
+    /* Sprites the OAM scan found on the current line, highest priority first */
+    uint8_t line_objs[OBJS_PER_LINE];
+    uint8_t line_obj_count;
+    /* Shade (0 lightest - 3 darkest) of every pixel, complete once frames is incremented */
+    uint8_t framebuffer[HEIGHT][WIDTH];
+    /* Time of the next state transition */
     uintptr_t clocks;
-    uintptr_t mode_clocks;
+    uintptr_t frames;
+    /*
+     * One frame out of every render_ratio is drawn, all of them by default. The others, and every
+     * frame when it is 0, keep all the timing and interrupts but leave the framebuffer as it was.
+     * A host setting, save states don't store it.
+     */
+    uint16_t render_ratio;
+    /* Whether the frame in progress is drawn, decided as it starts */
+    bool render;
+#ifdef PPU_FIFO
+    ppu_fifo_t fifo;
+#endif
 } ppu;
 
 ppu ppu_new(bus *bus);
+/* Points the register fields at bus, needed whenever the bus has moved */
+void ppu_map_registers(ppu *ppu, bus *bus);
 uintptr_t ppu_clock(ppu *ppu);
+/* Finds the sprites on line *ppu->ly, done at the end of the OAM state of every line */
+void ppu_scan_oam(ppu *ppu);
+/* Index into bus->tiles of tile number n of the tile data selected in LCDC */
+uint16_t ppu_tile_index(ppu *ppu, uint8_t n);
+#ifdef PPU_FIFO
+void ppu_fifo_start_frame(ppu *ppu);
+void ppu_fifo_start_line(ppu *ppu);
+/* Draws the dots of one clock, false once the line is complete */
+bool ppu_fifo_step(ppu *ppu);
+#else
+/* Renders line *ppu->ly into the framebuffer, replaying the register writes made while drawing */
+void ppu_draw_scanline(ppu *ppu);
+#endif
 void ppu_free(ppu ppu);
 #endif
@@ -0,0 +1,208 @@
+#include "ppu.h"
+#include <string.h>
+
+/*
+ * Dot by dot model of the DMG pixel pipeline. A fetcher reads a tile number and a row of tile
+ * data over six dots and pushes the 8 pixels into the background FIFO once it has run empty.
+ * One pixel is shifted out per dot. Sprites stop both while they are fetched and are mixed in
+ * through their own FIFO, and the window restarts the fetcher. The draw state lasts as long as
+ * all of that takes, from 172 dots up.
+ */
+
+/* Fetcher step at which the fetched row waits for the background FIFO to empty */
+#define FETCH_PUSH 6
+/* The first fetch of every line is thrown away */
+#define FETCH_DUMMY_DOTS 6
+#define OBJ_FETCH_DOTS 6
+#define OBJ_ATTR_PALETTE 0x01
+#define OBJ_ATTR_BG_OVER 0x02
+
+void ppu_fifo_start_frame(ppu *ppu) {
+    ppu->fifo.window_line = 0;
+    ppu->fifo.window_y_hit = false;
+}
+
+void ppu_fifo_start_line(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+
+    f->bg_head = 0;
+    f->bg_count = 0;
+    memset(f->obj, 0, sizeof(f->obj));
+    f->obj_head = 0;
+    f->step = 0;
+    f->fetch_x = 0;
+    f->lx = 0;
+    /* SCX is only read here for the pixels dropped from the first tile */
+    f->discard = *ppu->scroll_x % 8;
+    f->stall = FETCH_DUMMY_DOTS;
+    f->obj_dots = 0;
+    f->next_obj = 0;
+    f->in_window = false;
+    f->dots = 0;
+    if (*ppu->ly == *ppu->window_y)
+        f->window_y_hit = true;
+}
+
+/* Advances the background fetcher by one dot */
+void ppu_fifo_fetch(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+    uint8_t i;
+
+    switch (f->step) {
+    case 1:
+        if (f->in_window) {
+            uint16_t map = ppu->lcdc->wmap == first_wmap_e ? 0x9800 : 0x9C00;
+            f->tile_num =
+                ppu->bus->vram[map - VRAM_START + (f->window_line / 8) * 32 + f->fetch_x % 32];
+        } else {
+            uint16_t map = ppu->lcdc->bgmap == first_bgmap_e ? 0x9800 : 0x9C00;
+            uint8_t y = *ppu->ly + *ppu->scroll_y;
+            f->tile_num = ppu->bus->vram[map - VRAM_START + (y / 8) * 32 +
+                                         (*ppu->scroll_x / 8 + f->fetch_x) % 32];
+        }
+        break;
+    case 5: {
+        uint8_t y = f->in_window ? f->window_line : *ppu->ly + *ppu->scroll_y;
+        memcpy(f->row, ppu->bus->tiles[ppu_tile_index(ppu, f->tile_num)][y % 8], 8);
+        break;
+    }
+    case FETCH_PUSH:
+        if (f->bg_count != 0)
+            return;
+        for (i = 0; i < 8; i++)
+            f->bg[(f->bg_head + i) % 16] = f->row[i];
+        f->bg_count = 8;
+        f->fetch_x++;
+        f->step = 0;
+        return;
+    }
+    f->step++;
+}
+
+/* Whether the next sprite on the line starts at or left of the next pixel */
+bool ppu_fifo_obj_due(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+    return ppu->lcdc->obj_enable && f->next_obj < ppu->line_obj_count &&
+           ppu->objs[ppu->line_objs[f->next_obj]].xpos <= f->lx + OBJ_X_OFFSET;
+}
+
+/* Mixes the next sprite into the sprite FIFO, where no sprite fetched before it has a pixel */
+void ppu_fifo_merge_obj(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+    struct sprite sprite = ppu->objs[ppu->line_objs[f->next_obj++]];
+    uint8_t height = ppu->lcdc->obj_size == tall_obj_size_e ? 16 : 8;
+    int16_t line = *ppu->ly + OBJ_Y_OFFSET - sprite.ypos;
+    uint16_t tile = height == 16 ? sprite.tile_idx & 0xFE : sprite.tile_idx;
+    uint8_t attrs = (sprite.attrs.palette == obp1_palette_e ? OBJ_ATTR_PALETTE : 0) |
+                    (sprite.attrs.bg_over ? OBJ_ATTR_BG_OVER : 0);
+    const uint8_t *row;
+    uint8_t x;
+
+    /* LCDC may have changed the sprite size since the scan */
+    if (line < 0 || line >= height)
+        return;
+    if (sprite.attrs.yflip)
+        line = height - 1 - line;
+    row = ppu->bus->tiles[tile + line / 8][line % 8];
+    for (x = 0; x < 8; x++) {
+        /* Pixels already shifted out, or left of the screen, are lost */
+        int16_t pos = sprite.xpos - OBJ_X_OFFSET + x - f->lx;
+        uint8_t idx = row[sprite.attrs.xflip ? 7 - x : x];
+        uint8_t slot;
+
+        if (pos < 0 || pos >= 8 || idx == 0)
+            continue;
+        slot = (f->obj_head + pos) % 8;
+        if (f->obj[slot] != 0)
+            continue;
+        f->obj[slot] = idx;
+        f->obj_attrs[slot] = attrs;
+    }
+}
+
+/* Shifts one pixel out of the FIFOs, onto the screen unless it is dropped */
+void ppu_fifo_output(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+    uint8_t bg = f->bg[f->bg_head];
+    uint8_t obj;
+    uint8_t attrs;
+    uint8_t shade;
+
+    f->bg_head = (f->bg_head + 1) % 16;
+    f->bg_count--;
+    if (f->discard > 0) {
+        f->discard--;
+        return;
+    }
+    obj = f->obj[f->obj_head];
+    attrs = f->obj_attrs[f->obj_head];
+    f->obj[f->obj_head] = 0;
+    f->obj_head = (f->obj_head + 1) % 8;
+    if (!ppu->render) {
+        f->lx++;
+        return;
+    }
+
+    /* Without the background every pixel of it is white, sprites still show */
+    if (!ppu->lcdc->bg_win_enable)
+        bg = 0;
+    shade = ppu->lcdc->bg_win_enable ? ppu->bus->palettes[PALETTE_BGP][bg] : 0;
+    if (obj != 0 && ppu->lcdc->obj_enable && (!(attrs & OBJ_ATTR_BG_OVER) || bg == 0))
+        shade = ppu->bus->palettes[attrs & OBJ_ATTR_PALETTE ? PALETTE_OBP1 : PALETTE_OBP0][obj];
+    ppu->framebuffer[*ppu->ly][f->lx++] = shade;
+}
+
+/* Restarts the fetcher on the window once the line reaches WX */
+void ppu_fifo_check_window(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+
+    if (f->in_window || !ppu->lcdc->window_enable || !f->window_y_hit ||
+        f->lx + 7 < *ppu->window_x)
+        return;
+    f->in_window = true;
+    f->bg_count = 0;
+    f->step = 0;
+    f->fetch_x = 0;
+    /* Replaces the SCX pixels still to drop, WX below 7 starts the window left of the screen */
+    f->discard = *ppu->window_x < 7 ? 7 - *ppu->window_x : 0;
+}
+
+void ppu_fifo_dot(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+
+    f->dots++;
+    if (f->stall > 0) {
+        f->stall--;
+        return;
+    }
+    if (f->obj_dots > 0) {
+        if (--f->obj_dots == 0)
+            ppu_fifo_merge_obj(ppu);
+        return;
+    }
+    if (ppu_fifo_obj_due(ppu)) {
+        /* The background fetch in progress is finished first, then both FIFOs wait */
+        if (f->step < FETCH_PUSH - 1)
+            ppu_fifo_fetch(ppu);
+        else
+            f->obj_dots = OBJ_FETCH_DOTS - 1;
+        return;
+    }
+    ppu_fifo_check_window(ppu);
+    ppu_fifo_fetch(ppu);
+    if (f->bg_count > 0)
+        ppu_fifo_output(ppu);
+}
+
+bool ppu_fifo_step(ppu *ppu) {
+    ppu_fifo_t *f = &ppu->fifo;
+    uint8_t i;
+
+    for (i = 0; i < DOTS_PER_CLOCK && f->lx < WIDTH; i++)
+        ppu_fifo_dot(ppu);
+    if (f->lx < WIDTH)
+        return true;
+    if (f->in_window)
+        f->window_line++;
+    return false;
+}
@@ -0,0 +1,248 @@
+#include "savestate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Header checksum and global checksum identify the ROM a state belongs to */
+#define ROM_CHECKSUM_ADDR 0x014D
+#define ROM_CHECKSUM_LEN 3
+/* magic, version, ROM size, ROM checksums */
+#define SAVESTATE_HEADER_SIZE (SAVESTATE_MAGIC_LEN + 1 + 4 + ROM_CHECKSUM_LEN)
+
+/* Either serializes into out or restores from in, so every field is listed exactly once */
+typedef struct {
+    uint8_t *out;
+    const uint8_t *in;
+    size_t pos;
+} state_stream;
+
+void state_bytes(state_stream *s, void *data, size_t n) {
+    /* data may be NULL for empty fields, such as external RAM on cartridges without it */
+    if (n == 0)
+        return;
+    if (s->in != NULL)
+        memcpy(data, s->in + s->pos, n);
+    else if (s->out != NULL)
+        memcpy(s->out + s->pos, data, n);
+    s->pos += n;
+}
+
+void state_u8(state_stream *s, uint8_t *n) {
+    state_bytes(s, n, 1);
+}
+
+void state_u16(state_stream *s, uint16_t *n) {
+    uint8_t b[2];
+    b[0] = *n & 0xFF;
+    b[1] = *n >> 8;
+    state_bytes(s, b, sizeof(b));
+    *n = b[0] | (b[1] << 8);
+}
+
+void state_u32(state_stream *s, uint32_t *n) {
+    uint16_t lo = *n & 0xFFFF;
+    uint16_t hi = *n >> 16;
+    state_u16(s, &lo);
+    state_u16(s, &hi);
+    *n = lo | ((uint32_t)hi << 16);
+}
+
+/* Clock counters are stored as 64 bits regardless of the size of uintptr_t */
+void state_clocks(state_stream *s, uintptr_t *n) {
+    uint32_t lo = *n & 0xFFFFFFFF;
+    uint32_t hi = (*n >> 16) >> 16;
+    state_u32(s, &lo);
+    state_u32(s, &hi);
+    *n = lo | (((uintptr_t)hi << 16) << 16);
+}
+
+void state_header(state_stream *s, gamegirl *gg) {
+    char magic[] = SAVESTATE_MAGIC;
+    uint8_t version = SAVESTATE_VERSION;
+    uint32_t rom_size = gg->bus.cart.size;
+    state_bytes(s, magic, SAVESTATE_MAGIC_LEN);
+    state_u8(s, &version);
+    state_u32(s, &rom_size);
+    state_bytes(s, &gg->bus.cart.data[ROM_CHECKSUM_ADDR], ROM_CHECKSUM_LEN);
+}
+
+void state_machine(state_stream *s, gamegirl *gg) {
+    cpu *c = &gg->cpu;
+    bus *b = &gg->bus;
+    cartridge_t *cart = &b->cart;
+    mbc_t *m = &cart->mbc;
+#ifdef PPU_FIFO
+    ppu_fifo_t *f = &gg->ppu.fifo;
+#endif
+    /* Stored as the register pairs they make up */
+    uint16_t regs[4];
+    uint8_t mode = c->mode;
+    uint8_t i;
+
+    /* F is stored up to date, so states don't depend on how the flags were last set */
+    regs[0] = get_reg_af(c);
+    regs[1] = get_reg_bc(c);
+    regs[2] = get_reg_de(c);
+    regs[3] = get_reg_hl(c);
+    for (i = 0; i < 4; i++)
+        state_u16(s, &regs[i]);
+    set_reg_af(c, regs[0]);
+    set_reg_bc(c, regs[1]);
+    set_reg_de(c, regs[2]);
+    set_reg_hl(c, regs[3]);
+    state_u16(s, &c->sp);
+    state_u16(s, &c->pc);
+    state_u8(s, &mode);
+    c->mode = mode;
+    state_u8(s, &c->ime);
+    state_u8(s, &c->ei_delay);
+    state_clocks(s, &c->clocks);
+
+    /* The boot ROM is constant and not part of the state */
+    state_bytes(s, b->vram, VRAM_SIZE);
+    state_bytes(s, b->ram, RAM_SIZE);
+    state_bytes(s, b->sat, SAT_SIZE);
+    state_bytes(s, b->io, IO_SIZE);
+    state_bytes(s, b->hram, HRAM_SIZE);
+    state_u8(s, &b->ie_reg);
+    state_clocks(s, &b->div_reset);
+    state_clocks(s, &b->tima_synced);
+    state_u8(s, &b->raster_count);
+    for (i = 0; i < RASTER_LOG_SIZE; i++) {
+        state_clocks(s, &b->raster_log[i].when);
+        state_u8(s, &b->raster_log[i].reg);
+        state_u8(s, &b->raster_log[i].old);
+        state_u8(s, &b->raster_log[i].value);
+    }
+
+    state_u8(s, &m->ram_enable);
+    state_u16(s, &m->rom_bank);
+    state_u8(s, &m->ram_bank);
+    state_u8(s, &m->bank_hi);
+    state_u8(s, &m->mode);
+    state_bytes(s, m->rtc, RTC_REG_COUNT);
+    state_bytes(s, m->rtc_latched, RTC_REG_COUNT);
+    state_u8(s, &m->latch);
+    state_bytes(s, cart->ram, cart->ram_size);
+
+    state_clocks(s, &gg->ppu.clocks);
+    state_clocks(s, &gg->ppu.frames);
+    state_bytes(s, gg->ppu.line_objs, OBJS_PER_LINE);
+    state_u8(s, &gg->ppu.line_obj_count);
+    /*
+     * render_ratio and render are left out on purpose. Frame skipping is chosen by the host, a
+     * state keeps the setting of the machine it is loaded into and never changes the emulation.
+     */
+#ifdef PPU_FIFO
+    state_bytes(s, f->bg, sizeof(f->bg));
+    state_u8(s, &f->bg_head);
+    state_u8(s, &f->bg_count);
+    state_bytes(s, f->obj, sizeof(f->obj));
+    state_bytes(s, f->obj_attrs, sizeof(f->obj_attrs));
+    state_u8(s, &f->obj_head);
+    state_u8(s, &f->step);
+    state_u8(s, &f->fetch_x);
+    state_u8(s, &f->tile_num);
+    state_bytes(s, f->row, sizeof(f->row));
+    state_u8(s, &f->lx);
+    state_u8(s, &f->discard);
+    state_u8(s, &f->stall);
+    state_u8(s, &f->obj_dots);
+    state_u8(s, &f->next_obj);
+    state_u8(s, &f->in_window);
+    state_u16(s, &f->dots);
+    state_u8(s, &f->window_line);
+    state_u8(s, &f->window_y_hit);
+#endif
+    state_bytes(s, gg->ppu.framebuffer, sizeof(gg->ppu.framebuffer));
+
+    for (i = 0; i < SCHED_EVENT_COUNT; i++) {
+        uint8_t idx = gg->sched.index[i];
+        uint8_t pending = idx != SCHED_EVENT_COUNT;
+        uintptr_t when = pending ? gg->sched.heap[idx].when : 0;
+        state_u8(s, &pending);
+        state_clocks(s, &when);
+        if (s->in == NULL)
+            continue;
+        if (pending)
+            scheduler_schedule(&gg->sched, i, when);
+        else
+            scheduler_cancel(&gg->sched, i);
+    }
+}
+
+size_t savestate_size(gamegirl *gg) {
+    state_stream s;
+    s.out = NULL;
+    s.in = NULL;
+    s.pos = 0;
+    state_header(&s, gg);
+    state_machine(&s, gg);
+    return s.pos;
+}
+
+size_t savestate_save(gamegirl *gg, uint8_t *buf, size_t len) {
+    state_stream s;
+    if (len < savestate_size(gg))
+        return 0;
+    s.out = buf;
+    s.in = NULL;
+    s.pos = 0;
+    state_header(&s, gg);
+    state_machine(&s, gg);
+    return s.pos;
+}
+
+bool savestate_load(gamegirl *gg, const uint8_t *buf, size_t len) {
+    uint8_t header[SAVESTATE_HEADER_SIZE];
+    state_stream s;
+
+    if (len != savestate_size(gg))
+        return false;
+    s.out = header;
+    s.in = NULL;
+    s.pos = 0;
+    state_header(&s, gg);
+    if (memcmp(header, buf, SAVESTATE_HEADER_SIZE) != 0)
+        return false;
+
+    s.out = NULL;
+    s.in = buf;
+    state_machine(&s, gg);
+    gamegirl_rebase(gg);
+    return true;
+}
+
+bool savestate_save_file(gamegirl *gg, char *path) {
+    size_t len = savestate_size(gg);
+    uint8_t *buf = malloc(len);
+    FILE *f;
+    bool ok;
+
+    if (buf == NULL)
+        PANIC("allocating save state failed");
+    savestate_save(gg, buf, len);
+    f = fopen(path, "wb");
+    ok = f != NULL && fwrite(buf, 1, len, f) == len;
+    if (f != NULL && fclose(f) != 0)
+        ok = false;
+    free(buf);
+    return ok;
+}
+
+bool savestate_load_file(gamegirl *gg, char *path) {
+    size_t len = savestate_size(gg);
+    /* One extra byte to notice files that are too long */
+    uint8_t *buf = malloc(len + 1);
+    FILE *f;
+    bool ok;
+
+    if (buf == NULL)
+        PANIC("allocating save state failed");
+    f = fopen(path, "rb");
+    ok = f != NULL && fread(buf, 1, len + 1, f) == len && savestate_load(gg, buf, len);
+    if (f != NULL)
+        fclose(f);
+    free(buf);
+    return ok;
+}
@@ -0,0 +1,29 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include "gameboy.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Save states are a flat little endian dump of every field that makes up the machine, prefixed
+ * by a header identifying the format version and the ROM. Pointers are never stored, they are
+ * rebuilt with gamegirl_rebase on load, so a state can be restored into any gamegirl running
+ * the same ROM.
+ */
+
+#define SAVESTATE_MAGIC "GBSTATE"
+#define SAVESTATE_MAGIC_LEN 7
+#define SAVESTATE_VERSION 6
+
+/* Size of a state of gg, constant for a given ROM */
+size_t savestate_size(gamegirl *gg);
+/* Returns the bytes written, or 0 if buf is smaller than savestate_size */
+size_t savestate_save(gamegirl *gg, uint8_t *buf, size_t len);
+/* Returns false and leaves gg untouched if buf isn't a state of this version and ROM */
+bool savestate_load(gamegirl *gg, const uint8_t *buf, size_t len);
+
+bool savestate_save_file(gamegirl *gg, char *path);
+bool savestate_load_file(gamegirl *gg, char *path);
+
+#endif
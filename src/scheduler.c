@@ -0,0 +1,92 @@
+#include "scheduler.h"
+
+scheduler scheduler_new(const uintptr_t *clocks) {
+    scheduler s;
+    uint8_t i;
+    for (i = 0; i < SCHED_EVENT_COUNT; i++)
+        s.index[i] = SCHED_EVENT_COUNT;
+    s.size = 0;
+    s.clocks = clocks;
+    return s;
+}
+
+uintptr_t scheduler_now(scheduler *self) {
+    return *self->clocks;
+}
+
+void scheduler_swap(scheduler *self, uint8_t a, uint8_t b) {
+    sched_entry_t tmp = self->heap[a];
+    self->heap[a] = self->heap[b];
+    self->heap[b] = tmp;
+    self->index[self->heap[a].event] = a;
+    self->index[self->heap[b].event] = b;
+}
+
+void scheduler_sift_up(scheduler *self, uint8_t i) {
+    while (i > 0) {
+        uint8_t parent = (i - 1) / 2;
+        if (self->heap[parent].when <= self->heap[i].when)
+            break;
+        scheduler_swap(self, parent, i);
+        i = parent;
+    }
+}
+
+void scheduler_sift_down(scheduler *self, uint8_t i) {
+    for (;;) {
+        uint8_t left = 2 * i + 1;
+        uint8_t right = left + 1;
+        uint8_t min = i;
+        if (left < self->size && self->heap[left].when < self->heap[min].when)
+            min = left;
+        if (right < self->size && self->heap[right].when < self->heap[min].when)
+            min = right;
+        if (min == i)
+            break;
+        scheduler_swap(self, min, i);
+        i = min;
+    }
+}
+
+void scheduler_schedule(scheduler *self, sched_event_t event, uintptr_t when) {
+    uint8_t i = self->index[event];
+    if (i == SCHED_EVENT_COUNT) {
+        i = self->size++;
+        self->heap[i].event = event;
+        self->index[event] = i;
+    }
+    self->heap[i].when = when;
+    scheduler_sift_up(self, i);
+    scheduler_sift_down(self, self->index[event]);
+}
+
+void scheduler_remove_at(scheduler *self, uint8_t i) {
+    uint8_t last = --self->size;
+    uint8_t moved = self->heap[last].event;
+    self->index[self->heap[i].event] = SCHED_EVENT_COUNT;
+    if (i == last)
+        return;
+    self->heap[i] = self->heap[last];
+    self->index[moved] = i;
+    scheduler_sift_up(self, i);
+    scheduler_sift_down(self, self->index[moved]);
+}
+
+void scheduler_cancel(scheduler *self, sched_event_t event) {
+    if (self->index[event] != SCHED_EVENT_COUNT)
+        scheduler_remove_at(self, self->index[event]);
+}
+
+uintptr_t scheduler_next(scheduler *self) {
+    return self->size == 0 ? SCHED_NEVER : self->heap[0].when;
+}
+
+int scheduler_pop(scheduler *self, uintptr_t now, uintptr_t *when) {
+    int event;
+    if (self->size == 0 || self->heap[0].when > now)
+        return -1;
+    event = self->heap[0].event;
+    *when = self->heap[0].when;
+    scheduler_remove_at(self, 0);
+    return event;
+}
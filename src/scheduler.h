@@ -0,0 +1,43 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "utils.h"
+#include <stdint.h>
+
+/* Timestamp used when nothing is scheduled */
+#define SCHED_NEVER ((uintptr_t)-1)
+
+/* Every event kind is pending at most once, rescheduling it moves the existing entry */
+typedef enum {
+    sched_ppu_e,    /* Next lcd state transition */
+    sched_serial_e, /* Serial transfer started through SC completes */
+    sched_dma_e,    /* OAM DMA started through 0xFF46 completes */
+    sched_timer_e,  /* TIMA overflows */
+    SCHED_EVENT_COUNT
+} sched_event_t;
+
+typedef struct {
+    uintptr_t when;
+    uint8_t event;
+} sched_entry_t;
+
+/* Binary min-heap of pending events ordered by timestamp, measured in CPU clocks */
+typedef struct scheduler {
+    sched_entry_t heap[SCHED_EVENT_COUNT];
+    /* Heap index of every event, SCHED_EVENT_COUNT when it is not pending */
+    uint8_t index[SCHED_EVENT_COUNT];
+    uint8_t size;
+    /* Clock counter events are scheduled relative to */
+    const uintptr_t *clocks;
+} scheduler;
+
+scheduler scheduler_new(const uintptr_t *clocks);
+uintptr_t scheduler_now(scheduler *self);
+/* Schedules or reschedules event at the absolute time when */
+void scheduler_schedule(scheduler *self, sched_event_t event, uintptr_t when);
+void scheduler_cancel(scheduler *self, sched_event_t event);
+uintptr_t scheduler_next(scheduler *self);
+/* Removes the earliest event if it is due at now, returns -1 if none is */
+int scheduler_pop(scheduler *self, uintptr_t now, uintptr_t *when);
+
+#endif
@@ -0,0 +1,135 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TRACING
+uint8_t trace_mask = TRACING;
+trace_record_t trace_ring[TRACE_RING_SIZE];
+/* Total records emitted, the ring holds the last TRACE_RING_SIZE of them */
+uint32_t trace_count = 0;
+const uintptr_t *trace_clocks = NULL;
+
+uint8_t trace_parse_categories(const char *list) {
+    uint8_t mask = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        if (len == 3 && strncmp(p, "cpu", len) == 0)
+            mask |= TRACE_CPU;
+        else if (len == 3 && strncmp(p, "bus", len) == 0)
+            mask |= TRACE_BUS;
+        else if (len == 3 && strncmp(p, "ppu", len) == 0)
+            mask |= TRACE_PPU;
+        else if (len == 3 && strncmp(p, "all", len) == 0)
+            mask |= TRACE_ALL;
+        else if (len != 0)
+            fprintf(stderr, "Unknown trace category: %.*s\n", (int)len, p);
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    return mask;
+}
+#endif
+
+void trace_init(const uintptr_t *clocks) {
+#ifdef TRACING
+    char *list = getenv("GAMEBOY_TRACE");
+    trace_clocks = clocks;
+    trace_count = 0;
+    if (list != NULL)
+        trace_mask = TRACING & trace_parse_categories(list);
+#else
+    (void)clocks;
+#endif
+}
+
+void trace_emit(trace_kind_t kind, uint16_t addr, uint16_t data, uint8_t value) {
+#ifdef TRACING
+    trace_record_t *rec = &trace_ring[trace_count++ & (TRACE_RING_SIZE - 1)];
+    rec->clocks = trace_clocks != NULL ? (uint32_t)*trace_clocks : 0;
+    rec->addr = addr;
+    rec->data = data;
+    rec->kind = kind;
+    rec->value = value;
+#else
+    (void)kind;
+    (void)addr;
+    (void)data;
+    (void)value;
+#endif
+}
+
+void trace_dump() {
+#ifdef TRACING
+    char *path = getenv("GAMEBOY_TRACE_FILE");
+    uint8_t buf[TRACE_HEADER_SIZE + TRACE_RECORD_SIZE];
+    uint32_t count = trace_count < TRACE_RING_SIZE ? trace_count : TRACE_RING_SIZE;
+    uint32_t i;
+    FILE *f;
+
+    if (trace_count == 0)
+        return;
+    if (path == NULL)
+        path = TRACE_DEFAULT_PATH;
+    f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Could not open trace file %s\n", path);
+        return;
+    }
+    trace_encode_header(buf, trace_mask, count);
+    fwrite(buf, 1, TRACE_HEADER_SIZE, f);
+    for (i = trace_count - count; i != trace_count; i++) {
+        trace_encode_record(buf, &trace_ring[i & (TRACE_RING_SIZE - 1)]);
+        fwrite(buf, 1, TRACE_RECORD_SIZE, f);
+    }
+    fclose(f);
+#endif
+}
+
+void trace_put_u16(uint8_t *buf, uint16_t n) {
+    buf[0] = n & 0xFF;
+    buf[1] = n >> 8;
+}
+
+void trace_put_u32(uint8_t *buf, uint32_t n) {
+    trace_put_u16(buf, n & 0xFFFF);
+    trace_put_u16(buf + 2, n >> 16);
+}
+
+uint16_t trace_get_u16(const uint8_t *buf) {
+    return buf[0] | (buf[1] << 8);
+}
+
+uint32_t trace_get_u32(const uint8_t *buf) {
+    return trace_get_u16(buf) | ((uint32_t)trace_get_u16(buf + 2) << 16);
+}
+
+void trace_encode_header(uint8_t *buf, uint8_t mask, uint32_t count) {
+    memcpy(buf, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    buf[TRACE_MAGIC_LEN] = TRACE_VERSION;
+    buf[TRACE_MAGIC_LEN + 1] = mask;
+    trace_put_u32(buf + TRACE_MAGIC_LEN + 2, count);
+}
+
+long trace_decode_header(const uint8_t *buf) {
+    if (memcmp(buf, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0 || buf[TRACE_MAGIC_LEN] != TRACE_VERSION)
+        return -1;
+    return trace_get_u32(buf + TRACE_MAGIC_LEN + 2);
+}
+
+void trace_encode_record(uint8_t *buf, const trace_record_t *rec) {
+    trace_put_u32(buf, rec->clocks);
+    trace_put_u16(buf + 4, rec->addr);
+    trace_put_u16(buf + 6, rec->data);
+    buf[8] = rec->kind;
+    buf[9] = rec->value;
+}
+
+void trace_decode_record(const uint8_t *buf, trace_record_t *rec) {
+    rec->clocks = trace_get_u32(buf);
+    rec->addr = trace_get_u16(buf + 4);
+    rec->data = trace_get_u16(buf + 6);
+    rec->kind = buf[8];
+    rec->value = buf[9];
+}
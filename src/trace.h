@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "utils.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Event tracing into an in-memory ring buffer which is dumped in a binary format and decoded
+ * offline by gameboy_tracedump. Building with -DTRACING=<mask> compiles in the categories in
+ * <mask>, GAMEBOY_TRACE (e.g. "cpu,ppu") narrows them down at run time. Without TRACING every
+ * TRACE() expands to nothing, arguments included.
+ */
+
+#define TRACE_CPU 0x01
+#define TRACE_BUS 0x02
+#define TRACE_PPU 0x04
+#define TRACE_ALL 0xFF
+
+#define TRACE_MAGIC "GBTRACE"
+#define TRACE_MAGIC_LEN 7
+#define TRACE_VERSION 1
+/* magic, version, category mask, record count */
+#define TRACE_HEADER_SIZE (TRACE_MAGIC_LEN + 1 + 1 + 4)
+/* clocks, addr, data, kind, value; all little endian */
+#define TRACE_RECORD_SIZE (4 + 2 + 2 + 1 + 1)
+/* Must be a power of two */
+#define TRACE_RING_SIZE 0x10000
+#define TRACE_DEFAULT_PATH "gameboy.trace"
+
+typedef enum {
+    /* addr: pc, data: the two bytes after the opcode, value: opcode */
+    trace_instr_e,
+    /* addr: address, value: byte written */
+    trace_write_e,
+    /* addr: ly, value: new lcd state */
+    trace_ppu_state_e
+} trace_kind_t;
+
+typedef struct {
+    uint32_t clocks;
+    uint16_t addr;
+    uint16_t data;
+    uint8_t kind;
+    uint8_t value;
+} trace_record_t;
+
+#ifdef TRACING
+extern uint8_t trace_mask;
+
+#define TRACE(cat, kind, addr, data, value)                                                        \
+    do {                                                                                           \
+        if (((cat) & TRACING) && (trace_mask & (cat)))                                             \
+            trace_emit((kind), (addr), (data), (value));                                           \
+    } while (0)
+#else
+#define TRACE(cat, kind, addr, data, value) ((void)0)
+#endif
+
+/* Selects categories from GAMEBOY_TRACE and the clock counter stamped on every record */
+void trace_init(const uintptr_t *clocks);
+void trace_emit(trace_kind_t kind, uint16_t addr, uint16_t data, uint8_t value);
+/* Writes the ring buffer, oldest record first, to GAMEBOY_TRACE_FILE */
+void trace_dump();
+
+void trace_encode_header(uint8_t *buf, uint8_t mask, uint32_t count);
+/* Returns the record count, or -1 if buf is not a trace this version understands */
+long trace_decode_header(const uint8_t *buf);
+void trace_encode_record(uint8_t *buf, const trace_record_t *rec);
+void trace_decode_record(const uint8_t *buf, trace_record_t *rec);
+
+#endif
@@ -0,0 +1,64 @@
+#include "decoder.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+const char *STATE_NAMES[4] = {"hblank", "vblank", "oam", "draw"};
+
+void print_record(const trace_record_t *rec) {
+    printf("%10lu ", (unsigned long)rec->clocks);
+    switch (rec->kind) {
+    case trace_instr_e: {
+        uint8_t bytes[3];
+        decoder_t d;
+        instruction_t instr;
+        char *str;
+        bytes[0] = rec->value;
+        bytes[1] = rec->data & 0xFF;
+        bytes[2] = rec->data >> 8;
+        d = decoder_new(bytes, sizeof(bytes));
+        instr = decoder_next(&d);
+        str = print_instruction(&instr);
+        printf("cpu   %04x  %s\n", rec->addr, str);
+        free(str);
+        break;
+    }
+    case trace_write_e:
+        printf("bus   %04x <- %02x\n", rec->addr, rec->value);
+        break;
+    case trace_ppu_state_e:
+        printf("ppu   ly %3u  %s\n", rec->addr, STATE_NAMES[rec->value & 0x03]);
+        break;
+    default:
+        printf("unknown record kind %u\n", rec->kind);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint8_t buf[TRACE_HEADER_SIZE];
+    trace_record_t rec;
+    long count;
+    long i;
+    FILE *f;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s trace\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    f = fopen(argv[1], "rb");
+    if (f == NULL)
+        PANIC("could not open %s", argv[1]);
+    if (fread(buf, 1, TRACE_HEADER_SIZE, f) != TRACE_HEADER_SIZE ||
+        (count = trace_decode_header(buf)) < 0)
+        PANIC("%s is not a version %d trace", argv[1], TRACE_VERSION);
+
+    for (i = 0; i < count; i++) {
+        if (fread(buf, 1, TRACE_RECORD_SIZE, f) != TRACE_RECORD_SIZE)
+            PANIC("%s is truncated after %ld records", argv[1], i);
+        trace_decode_record(buf, &rec);
+        print_record(&rec);
+    }
+    fclose(f);
+    return 0;
+}
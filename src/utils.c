@@ -1,7 +1,8 @@
 #include "utils.h"
-#include <SDL.h>
+#include "trace.h"
 #include <execinfo.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,11 +34,7 @@ void panic_handler(int sig) {
     /* print out all the frames to stderr */
     fprintf(stderr, "Error: signal %s\n", siglist[sig - 1]);
     backtrace_symbols_fd(array, size, STDERR_FILENO);
-    exit(EXIT_FAILURE);
-}
-
-void sdl_panic() {
-    printf("SDL ERROR: %s", SDL_GetError());
+    trace_dump();
     exit(EXIT_FAILURE);
 }
 
@@ -15,7 +15,6 @@
 
 void PANIC(char *msg, ...);
 void panic_handler(int sig);
-void sdl_panic();
 void LOG(char *name, char *msg, ...);
 
 #endif
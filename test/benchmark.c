@@ -0,0 +1,295 @@
+#define _POSIX_C_SOURCE 199309L
+#include "src/decoder.h"
+#include "src/gameboy.h"
+#include "src/pixel.h"
+#include "test/opcodes.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Prints one tab separated line per benchmark: name, iterations, seconds, rate and unit. Iteration
+ * counts are fixed so runs are comparable between commits, an optional argument scales them.
+ */
+
+#define CPU_ITERATIONS 20000000
+#define BLOCK_CLOCKS 100000000
+#define BUS_ITERATIONS 50000000
+#define DECODER_ITERATIONS 20000000
+#define PPU_ITERATIONS 200000
+#define PPU_FRAMES 2000
+#define PIXEL_ITERATIONS 20000
+#define MACHINE_CLOCKS 50000000
+#define ADDR_COUNT 0x1000
+
+/* Endless loop in WRAM mixing loads, stores, ALU, CB and branch opcodes */
+const uint8_t CPU_PROGRAM[] = {
+    0x21, 0x00, 0xD0, /* LD HL, 0xD000 */
+    0x7E,             /* LD A, (HL)    */
+    0x80,             /* ADD A, B      */
+    0x77,             /* LD (HL), A    */
+    0x2C,             /* INC L         */
+    0x04,             /* INC B         */
+    0xCB, 0x11,       /* RL C          */
+    0x18, 0xF7,       /* JR -9         */
+};
+#define CPU_PROGRAM_START 0xC000
+
+volatile uintptr_t sink;
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(char *name, uintptr_t iterations, double seconds, char *unit) {
+    printf("%s\t%lu\t%.6f\t%.0f\t%s\n", name, (unsigned long)iterations, seconds,
+           iterations / seconds, unit);
+    fflush(stdout);
+}
+
+/* Like report for rates too fast to read per second */
+void report_per_ns(char *name, uintptr_t iterations, double seconds, char *unit) {
+    printf("%s\t%lu\t%.6f\t%.3f\t%s\n", name, (unsigned long)iterations, seconds,
+           iterations / seconds / 1e9, unit);
+    fflush(stdout);
+}
+
+void bench_cpu(uintptr_t scale) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t n = CPU_ITERATIONS * scale;
+    uintptr_t i;
+    double start;
+
+    memcpy(&gg->bus.ram[CPU_PROGRAM_START - RAM_START], CPU_PROGRAM, sizeof(CPU_PROGRAM));
+    gg->cpu.pc = CPU_PROGRAM_START;
+    start = now();
+    for (i = 0; i < n; i++)
+        cpu_clock(&gg->cpu);
+    report("cpu_clock", n, now() - start, "instr/s");
+    sink = gg->cpu.clocks;
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* The same loop through the block cache, reported in clocks since blocks aren't counted */
+void bench_blocks(uintptr_t scale) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t n = BLOCK_CLOCKS * scale;
+    double start;
+
+    memcpy(&gg->bus.ram[CPU_PROGRAM_START - RAM_START], CPU_PROGRAM, sizeof(CPU_PROGRAM));
+    gg->cpu.pc = CPU_PROGRAM_START;
+    start = now();
+    cpu_run(&gg->cpu, n);
+    report("cpu_run", gg->cpu.clocks, now() - start, "clock/s");
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Addresses spread over ROM, VRAM, WRAM and HRAM, reads may hit all of them */
+void fill_addrs(uint16_t *addrs, int writable) {
+    uint32_t seed = 1;
+    int i;
+    for (i = 0; i < ADDR_COUNT; i++) {
+        seed = seed * 1103515245 + 12345;
+        switch ((seed >> 16) % (writable ? 3 : 4)) {
+        case 0:
+            addrs[i] = 0xC000 + (seed >> 8) % 0x2000;
+            break;
+        case 1:
+            addrs[i] = 0x8000 + (seed >> 8) % 0x2000;
+            break;
+        case 2:
+            addrs[i] = 0xFF80 + (seed >> 8) % 0x7F;
+            break;
+        default:
+            addrs[i] = (seed >> 8) % 0x8000;
+            break;
+        }
+    }
+}
+
+void bench_bus(uintptr_t scale) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint16_t addrs[ADDR_COUNT];
+    uintptr_t n = BUS_ITERATIONS * scale;
+    uintptr_t acc = 0;
+    uintptr_t i;
+    double start;
+
+    fill_addrs(addrs, 0);
+    start = now();
+    for (i = 0; i < n; i++)
+        acc += bus_read(&gg->bus, addrs[i & (ADDR_COUNT - 1)]);
+    report("bus_read", n, now() - start, "access/s");
+
+    fill_addrs(addrs, 1);
+    start = now();
+    for (i = 0; i < n; i++)
+        bus_write(&gg->bus, addrs[i & (ADDR_COUNT - 1)], i);
+    report("bus_write", n, now() - start, "access/s");
+    sink = acc;
+    gamegirl_free(gg);
+    free(gg);
+}
+
+void bench_decoder(uintptr_t scale) {
+    uintptr_t n = DECODER_ITERATIONS * scale;
+    uintptr_t acc = 0;
+    uintptr_t i;
+    decoder_t d = decoder_new(TEST_OPCODES, TEST_OPCODES_SIZE);
+    double start = now();
+    for (i = 0; i < n; i++) {
+        instruction_t instr = decoder_next(&d);
+        acc += instr.length;
+        if (d.idx >= TEST_OPCODES_SIZE)
+            d.idx = 0;
+    }
+    report("decoder_next", n, now() - start, "instr/s");
+    sink = acc;
+}
+
+/* Noisy tiles, a background map using all of them and 40 sprites spread over the screen */
+void fill_scene(gamegirl *gg) {
+    uint16_t i;
+
+    for (i = 0; i < 0x1800; i++)
+        gg->bus.vram[i] = (i * 0x35) ^ (i >> 4);
+    for (i = 0x1800; i < 0x2000; i++)
+        gg->bus.vram[i] = i & 0xFF;
+    for (i = 0; i < SAT_SIZE; i++)
+        gg->bus.sat[i] = (i * 37) & 0xFF;
+    bus_decode_tiles(&gg->bus);
+    bus_index_objs(&gg->bus);
+    bus_write(&gg->bus, 0xFF40, 0x93);
+    bus_write(&gg->bus, 0xFF47, 0xE4);
+    bus_write(&gg->bus, 0xFF48, 0xE4);
+    bus_write(&gg->bus, 0xFF49, 0x1B);
+}
+
+void bench_ppu(uintptr_t scale) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t n = PPU_ITERATIONS * scale;
+    uintptr_t i;
+    double start;
+
+    fill_scene(gg);
+    start = now();
+    for (i = 0; i < n; i++) {
+        *gg->ppu.ly = i % HEIGHT;
+        ppu_scan_oam(&gg->ppu);
+#ifdef PPU_FIFO
+        ppu_fifo_start_line(&gg->ppu);
+        while (ppu_fifo_step(&gg->ppu))
+            ;
+#else
+        ppu_draw_scanline(&gg->ppu);
+#endif
+    }
+    report("ppu_draw_" PPU_ENGINE, n, now() - start, "line/s");
+    sink = gg->ppu.framebuffer[HEIGHT / 2][WIDTH / 2];
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/*
+ * Whole frames through ppu_clock, what the engine selected at build time costs per frame. Drawing
+ * one frame in ratio, 0 for none.
+ */
+void bench_ppu_frames(uintptr_t scale, uint16_t ratio, char *name) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t n = PPU_FRAMES * scale;
+    double start;
+
+    fill_scene(gg);
+    gg->ppu.render_ratio = ratio;
+    gg->ppu.render = ratio != 0;
+    start = now();
+    while (gg->ppu.frames < n)
+        ppu_clock(&gg->ppu);
+    report(name, n, now() - start, "frame/s");
+    sink = gg->ppu.framebuffer[HEIGHT / 2][WIDTH / 2];
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Every kernel set the host supports over a whole frame, reported in pixels per nanosecond */
+void bench_pixels(uintptr_t scale) {
+    static uint8_t planes[HEIGHT * WIDTH / 4];
+    static uint8_t indices[HEIGHT * WIDTH];
+    static uint8_t shades[HEIGHT * WIDTH];
+    static uint32_t colors[HEIGHT * WIDTH];
+    const uint32_t palette[4] = {0xFFFFFFFF, 0xFFCCCCCC, 0xFF777777, 0xFF000000};
+    const uint8_t tables[4][4] = {{0, 1, 2, 3}, {3, 2, 1, 0}, {0, 0, 3, 3}, {2, 1, 1, 0}};
+    uintptr_t n = PIXEL_ITERATIONS * scale;
+    uintptr_t i;
+    uint8_t k;
+
+    for (i = 0; i < sizeof(planes); i++)
+        planes[i] = (i * 0x35) ^ (i >> 4);
+    for (k = 0; k < PIXEL_IMPL_COUNT; k++) {
+        const pixel_kernels *impl = &PIXEL_IMPLS[k];
+        char name[64];
+        double start;
+
+        if (!impl->supported())
+            continue;
+        start = now();
+        for (i = 0; i < n; i++)
+            impl->decode_rows(planes, indices, sizeof(planes) / 2);
+        sprintf(name, "pixel_decode_rows_%s", impl->name);
+        report_per_ns(name, n * sizeof(indices), now() - start, "pixel/ns");
+        start = now();
+        for (i = 0; i < n; i++)
+            impl->map_palette(indices, shades, sizeof(indices), tables[i % 4]);
+        sprintf(name, "pixel_map_palette_%s", impl->name);
+        report_per_ns(name, n * sizeof(indices), now() - start, "pixel/ns");
+        start = now();
+        for (i = 0; i < n; i++)
+            impl->expand(shades, colors, sizeof(shades), palette);
+        sprintf(name, "pixel_expand_%s", impl->name);
+        report_per_ns(name, n * sizeof(shades), now() - start, "pixel/ns");
+        sink = colors[i % (HEIGHT * WIDTH)];
+    }
+}
+
+/* The whole machine running the boot ROM, reported in emulated clocks */
+void bench_machine(uintptr_t scale) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t n = MACHINE_CLOCKS * scale;
+    double start;
+
+    /* HALT at the cartridge entry point, stopping the run once the boot ROM hands over */
+    gg->bus.cart.data[0x0100] = 0x76;
+    start = now();
+    while (gg->cpu.clocks < n && gg->cpu.mode == cpu_running_mode_e)
+        gamegirl_clock(gg);
+    report("gamegirl_clock", gg->cpu.clocks, now() - start, "clock/s");
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main(int argc, char **argv) {
+    uintptr_t scale = 1;
+    if (argc > 1)
+        scale = strtoul(argv[1], NULL, 0);
+    if (scale == 0) {
+        fprintf(stderr, "usage: %s [scale]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("# name\titerations\tseconds\trate\tunit\n");
+    bench_cpu(scale);
+    bench_blocks(scale);
+    bench_bus(scale);
+    bench_decoder(scale);
+    bench_ppu(scale);
+    bench_ppu_frames(scale, 1, "ppu_frame_" PPU_ENGINE);
+    bench_ppu_frames(scale, 0, "ppu_frame_" PPU_ENGINE "_timing");
+    bench_pixels(scale);
+    bench_machine(scale);
+    return 0;
+}
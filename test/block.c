@@ -0,0 +1,136 @@
+#include "src/block.h"
+#include "src/savestate.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUN_STEPS 20000
+
+/* clang-format off */
+const uint8_t TEST_PROGRAM[] = {
+    0x06, 0x11,       /* 0xC000: LD B, 0x11     */
+    0x18, 0xFE,       /* 0xC002: JR -2          */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3E, 0x44,       /* 0xC010: LD A, 0x44     */
+    0xEA, 0x16, 0xC0, /* 0xC012: LD (0xC016), A */
+    0x06, 0x00,       /* 0xC015: LD B, 0x00     */
+    0x18, 0xFE,       /* 0xC017: JR -2          */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF0, 0x44,       /* 0xC020: LDH A, (0x44)  */
+    0xFE, 0x90,       /* 0xC022: CP 0x90        */
+    0x20, 0xFA,       /* 0xC024: JR NZ, -6      */
+    0x04,             /* 0xC026: INC B          */
+    0x18, 0xF7,       /* 0xC027: JR -9          */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF0, 0x44,       /* 0xC030: LDH A, (0x44)  */
+    0x04,             /* 0xC032: INC B          */
+    0xFE, 0x90,       /* 0xC033: CP 0x90        */
+    0x20, 0xF9,       /* 0xC035: JR NZ, -7      */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF0, 0x04,       /* 0xC040: LDH A, (0x04)  */
+    0xFE, 0x90,       /* 0xC042: CP 0x90        */
+    0x20, 0xFA,       /* 0xC044: JR NZ, -6      */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xF0, 0x44,       /* 0xC050: LDH A, (0x44)  */
+    0xE0, 0x80,       /* 0xC052: LDH (0x80), A  */
+    0xFE, 0x90,       /* 0xC054: CP 0x90        */
+    0x20, 0xF8,       /* 0xC056: JR NZ, -8      */
+};
+/* clang-format on */
+
+/* Steps a machine using blocks next to a purely interpreted one, they have to end up the same */
+void run_lockstep(gamegirl *gg, gamegirl *interpreted, uint8_t *expected, uint8_t *actual,
+                  size_t len) {
+    uint16_t i;
+    block_cache_free(interpreted->cpu.blocks);
+    interpreted->cpu.blocks = NULL;
+    for (i = 0; i < RUN_STEPS; i++) {
+        gamegirl_clock(gg);
+        gamegirl_clock(interpreted);
+    }
+    savestate_save(gg, expected, len);
+    savestate_save(interpreted, actual, len);
+    assert(memcmp(expected, actual, len) == 0);
+}
+
+void run_from(gamegirl *gg, uint16_t pc) {
+    gg->cpu.pc = pc;
+    cpu_run(&gg->cpu, gg->cpu.clocks + 64);
+}
+
+int main() {
+    gamegirl *gg = gamegirl_init(NULL);
+    gamegirl *interpreted = gamegirl_init(NULL);
+    size_t len = savestate_size(gg);
+    uint8_t *expected = malloc(len);
+    uint8_t *actual = malloc(len);
+    uint8_t *rom = gg->bus.cart.data;
+    uint16_t i;
+
+    /* Blocks are told apart by the bank they were decoded from */
+    bus_write(&gg->bus, 0x2000, 1);
+    assert(block_lookup(gg->cpu.blocks, &gg->bus, 0x4000)->code == rom + 0x4000);
+    bus_write(&gg->bus, 0x2000, 2);
+    assert(block_lookup(gg->cpu.blocks, &gg->bus, 0x4000)->code == rom + 0x8000);
+    bus_write(&gg->bus, 0x2000, 1);
+
+    for (i = 0; i < sizeof(TEST_PROGRAM); i++)
+        bus_write(&gg->bus, 0xC000 + i, TEST_PROGRAM[i]);
+    run_from(gg, 0xC000);
+    assert(gg->cpu.pc == 0xC002);
+    assert(gg->cpu.regs[REG_B] == 0x11);
+    assert(gg->bus.code_pages[0xC0] && gg->bus.code_pages[0xE0]);
+
+    /* Writes to cached code, directly or through echo RAM, invalidate it */
+    bus_write(&gg->bus, 0xC001, 0x22);
+    assert(!gg->bus.code_pages[0xC0]);
+    run_from(gg, 0xC000);
+    assert(gg->cpu.regs[REG_B] == 0x22);
+    bus_write(&gg->bus, 0xE001, 0x33);
+    run_from(gg, 0xC000);
+    assert(gg->cpu.regs[REG_B] == 0x33);
+
+    /* Code patching the next instruction of its own block */
+    run_from(gg, 0xC010);
+    assert(gg->cpu.pc == 0xC017);
+    assert(gg->cpu.regs[REG_B] == 0x44);
+
+    /* Only loops without stores or state carried between iterations, polling LY, are idle */
+    assert(block_lookup(gg->cpu.blocks, &gg->bus, 0xC002)->idle);
+    assert(block_lookup(gg->cpu.blocks, &gg->bus, 0xC020)->idle);
+    assert(!block_lookup(gg->cpu.blocks, &gg->bus, 0xC030)->idle);
+    assert(!block_lookup(gg->cpu.blocks, &gg->bus, 0xC040)->idle);
+    assert(!block_lookup(gg->cpu.blocks, &gg->bus, 0xC050)->idle);
+    gamegirl_free(gg);
+    free(gg);
+
+    /* Blocks take exactly as many clocks as interpreting the same instructions */
+    gg = gamegirl_init(NULL);
+    run_lockstep(gg, interpreted, expected, actual, len);
+    gamegirl_free(interpreted);
+    free(interpreted);
+    gamegirl_free(gg);
+    free(gg);
+
+    /* Skipping ahead in an idle loop included */
+    gg = gamegirl_init(NULL);
+    interpreted = gamegirl_init(NULL);
+    for (i = 0; i < sizeof(TEST_PROGRAM); i++) {
+        bus_write(&gg->bus, 0xC000 + i, TEST_PROGRAM[i]);
+        bus_write(&interpreted->bus, 0xC000 + i, TEST_PROGRAM[i]);
+    }
+    gg->cpu.pc = 0xC020;
+    interpreted->cpu.pc = 0xC020;
+    run_lockstep(gg, interpreted, expected, actual, len);
+    assert(gg->cpu.regs[REG_B] > 0);
+
+    gamegirl_free(interpreted);
+    free(interpreted);
+    gamegirl_free(gg);
+    free(gg);
+    free(expected);
+    free(actual);
+    printf("Test: test_block passed!\n");
+    return 0;
+}
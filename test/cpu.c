@@ -1,5 +1,8 @@
 #include "src/gameboy.h"
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* clang-format off */
 const uint8_t TEST_BOOTROM[256] = {
@@ -205,6 +208,102 @@ const uint8_t TEST_BOOTROM[256] = {
 };
 /* clang-format on */
 
+/* Runs a single opcode on A and B with the given flags, returning F */
+uint8_t run_op(gamegirl *gg, uint16_t opcode, uint8_t a, uint8_t b, uint8_t f) {
+    const op_t *op = &CPU_OPS[opcode];
+    gg->cpu.regs[REG_A] = a;
+    gg->cpu.regs[REG_B] = b;
+    cpu_set_f(&gg->cpu, f);
+    op->fn(&gg->cpu, op);
+    return cpu_get_f(&gg->cpu);
+}
+
+void test_flags() {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    /* ADD A, B / ADC A, B */
+    assert(run_op(gg, 0x80, 0x0F, 0x01, 0) == FLAG_H);
+    assert(run_op(gg, 0x80, 0xF0, 0x10, 0) == (FLAG_Z | FLAG_C));
+    assert(run_op(gg, 0x88, 0x0E, 0x01, FLAG_C) == FLAG_H);
+    assert(run_op(gg, 0x88, 0xFF, 0x00, FLAG_C) == (FLAG_Z | FLAG_H | FLAG_C));
+    /* SUB A, B / SBC A, B / CP A, B */
+    assert(run_op(gg, 0x90, 0x10, 0x01, 0) == (FLAG_N | FLAG_H));
+    assert(run_op(gg, 0x90, 0x01, 0x02, 0) == (FLAG_N | FLAG_H | FLAG_C));
+    assert(run_op(gg, 0x98, 0x01, 0x00, FLAG_C) == (FLAG_Z | FLAG_N));
+    assert(run_op(gg, 0xB8, 0x42, 0x42, 0) == (FLAG_Z | FLAG_N));
+    assert(gg->cpu.regs[REG_A] == 0x42);
+    /* AND A, B / XOR A, B */
+    assert(run_op(gg, 0xA0, 0xF0, 0x0F, FLAG_C) == (FLAG_Z | FLAG_H));
+    assert(run_op(gg, 0xA8, 0xF0, 0x0F, FLAG_C) == 0);
+    /* INC B and DEC B leave C alone */
+    assert(run_op(gg, 0x04, 0x00, 0xFF, FLAG_C) == (FLAG_Z | FLAG_H | FLAG_C));
+    assert(run_op(gg, 0x05, 0x00, 0x10, 0) == (FLAG_N | FLAG_H));
+    /* RLCA clears Z, RL B doesn't */
+    assert(run_op(gg, 0x07, 0x00, 0x00, FLAG_Z) == 0);
+    assert(run_op(gg, 0x110, 0x00, 0x80, 0) == (FLAG_Z | FLAG_C));
+    assert(gg->cpu.regs[REG_B] == 0x00);
+    /* BIT 7, B */
+    assert(run_op(gg, 0x178, 0x00, 0x7F, FLAG_C) == (FLAG_Z | FLAG_H | FLAG_C));
+    /* DAA after 0x19 + 0x28 */
+    run_op(gg, 0x80, 0x19, 0x28, 0);
+    assert(run_op(gg, 0x27, gg->cpu.regs[REG_A], 0x00, cpu_get_f(&gg->cpu)) == 0);
+    assert(gg->cpu.regs[REG_A] == 0x47);
+
+    /* PUSH AF sees flags that were never written to F */
+    run_op(gg, 0x90, 0x01, 0x01, 0);
+    CPU_OPS[0xF5].fn(&gg->cpu, &CPU_OPS[0xF5]);
+    CPU_OPS[0xC1].fn(&gg->cpu, &CPU_OPS[0xC1]);
+    assert(gg->cpu.regs[REG_C] == (FLAG_Z | FLAG_N));
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* clang-format off */
+const uint8_t BRANCH_PROGRAM[] = {
+                      /* ADDRESS | MNEMONIC          */
+    0xC2, 0x00, 0x10, /* 0x0000  | JP NZ, 0x1000     */
+    0xCA, 0x08, 0x00, /* 0x0003  | JP Z, 0x0008      */
+    0x00, 0x00,
+    0x20, 0x10,       /* 0x0008  | JR NZ, +0x10      */
+    0x28, 0x00,       /* 0x000A  | JR Z, +0          */
+    0xC4, 0x00, 0x10, /* 0x000C  | CALL NZ, 0x1000   */
+    0xCC, 0x20, 0x00, /* 0x000F  | CALL Z, 0x0020    */
+    0xCD, 0x24, 0x00, /* 0x0012  | CALL 0x0024       */
+    0xC3, 0x1A, 0x00, /* 0x0015  | JP 0x001A         */
+    0x00, 0x00,
+    0x18, 0xFE,       /* 0x001A  | JR -2             */
+    0x00, 0x00, 0x00, 0x00,
+    0xC0,             /* 0x0020  | RET NZ            */
+    0xC8,             /* 0x0021  | RET Z             */
+    0x00, 0x00,
+    0xC9,             /* 0x0024  | RET               */
+};
+/* clang-format on */
+
+/* Clocks of each instruction of BRANCH_PROGRAM in the order it runs them, and pc after it */
+const uint8_t BRANCH_CLOCKS[] = {3, 4, 2, 3, 3, 6, 2, 5, 6, 4, 4, 3};
+const uint16_t BRANCH_PCS[] = {0x0003, 0x0008, 0x000A, 0x000C, 0x000F, 0x0020,
+                               0x0021, 0x0012, 0x0024, 0x0015, 0x001A, 0x001A};
+
+/* Taken conditional branches take longer than untaken ones, unconditional ones always as long */
+void test_branches() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint8_t i;
+
+    /* Runs from the boot ROM, with the stack in work RAM */
+    memcpy(gg->bus.bootrom, BRANCH_PROGRAM, sizeof(BRANCH_PROGRAM));
+    gg->cpu.sp = 0xCFFE;
+    cpu_set_f(&gg->cpu, FLAG_Z);
+    for (i = 0; i < sizeof(BRANCH_CLOCKS); i++) {
+        assert(cpu_clock(&gg->cpu) == BRANCH_CLOCKS[i]);
+        assert(gg->cpu.pc == BRANCH_PCS[i]);
+    }
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
 int main() {
     gamegirl *gg = gamegirl_init(NULL);
     memcpy(gg->bus.bootrom, TEST_BOOTROM, 256);
@@ -213,29 +312,29 @@ int main() {
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 4);
-    assert(gg->cpu.bc.u8.b == 0xCA);
-    assert(gg->cpu.bc.u8.c == 0xFE);
-    assert(gg->cpu.bc.u16 == 0xCAFE);
+    assert(gg->cpu.regs[REG_B] == 0xCA);
+    assert(gg->cpu.regs[REG_C] == 0xFE);
+    assert(get_reg_bc(&gg->cpu) == 0xCAFE);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 6);
-    assert(bus_read(&gg->bus, gg->cpu.bc.u16) == gg->cpu.af.u8.a);
+    assert(bus_read(&gg->bus, get_reg_bc(&gg->cpu)) == gg->cpu.regs[REG_A]);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 8);
-    assert(gg->cpu.bc.u16 == 0xCAFF);
+    assert(get_reg_bc(&gg->cpu) == 0xCAFF);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 9);
-    assert(gg->cpu.bc.u8.b == 0xCB);
+    assert(gg->cpu.regs[REG_B] == 0xCB);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 10);
-    assert(gg->cpu.bc.u8.b == 0xCA);
+    assert(gg->cpu.regs[REG_B] == 0xCA);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 12);
-    assert(gg->cpu.bc.u8.b == 0xAA);
+    assert(gg->cpu.regs[REG_B] == 0xAA);
 
     /* TODO: Check side effects of this */
     cpu_clock(&gg->cpu);
@@ -248,27 +347,27 @@ int main() {
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 20);
-    assert(gg->cpu.hl.u16 == 0xAAFF);
+    assert(get_reg_hl(&gg->cpu) == 0xAAFF);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 22);
-    assert(gg->cpu.af.u8.a == bus_read(&gg->bus, 0xAAFF));
+    assert(gg->cpu.regs[REG_A] == bus_read(&gg->bus, 0xAAFF));
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 24);
-    assert(gg->cpu.bc.u16 == 0xAAFE);
+    assert(get_reg_bc(&gg->cpu) == 0xAAFE);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 25);
-    assert(gg->cpu.bc.u8.c == 0xFF);
+    assert(gg->cpu.regs[REG_C] == 0xFF);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 26);
-    assert(gg->cpu.bc.u8.c == 0xFE);
+    assert(gg->cpu.regs[REG_C] == 0xFE);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 28);
-    assert(gg->cpu.bc.u8.c == 0xAA);
+    assert(gg->cpu.regs[REG_C] == 0xAA);
 
     /* TODO */
     cpu_clock(&gg->cpu);
@@ -280,27 +379,27 @@ int main() {
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 33);
-    assert(gg->cpu.de.u16 == 0xCAFE);
+    assert(get_reg_de(&gg->cpu) == 0xCAFE);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 35);
-    assert(bus_read(&gg->bus, 0xCAFE) == gg->cpu.af.u8.a);
+    assert(bus_read(&gg->bus, 0xCAFE) == gg->cpu.regs[REG_A]);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 37);
-    assert(gg->cpu.de.u16 == 0xCAFF);
+    assert(get_reg_de(&gg->cpu) == 0xCAFF);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 38);
-    assert(gg->cpu.de.u8.d == 0xCB);
+    assert(gg->cpu.regs[REG_D] == 0xCB);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 39);
-    assert(gg->cpu.de.u8.d == 0xCA);
+    assert(gg->cpu.regs[REG_D] == 0xCA);
 
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 41);
-    assert(gg->cpu.de.u8.d == 0xAA);
+    assert(gg->cpu.regs[REG_D] == 0xAA);
 
     /* TODO */
     cpu_clock(&gg->cpu);
@@ -330,7 +429,7 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 56);
 
-    gg->cpu.af.u8.f.bits.z = true;
+    cpu_set_f(&gg->cpu, cpu_get_f(&gg->cpu) | FLAG_Z);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 58);
 
@@ -349,7 +448,7 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 70);
 
-    gg->cpu.af.u8.f.bits.z = false;
+    cpu_set_f(&gg->cpu, cpu_get_f(&gg->cpu) & ~FLAG_Z);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 72);
 
@@ -368,7 +467,7 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 83);
 
-    gg->cpu.af.u8.f.bits.c = true;
+    cpu_set_f(&gg->cpu, cpu_get_f(&gg->cpu) | FLAG_C);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 85);
 
@@ -387,7 +486,7 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 102);
 
-    gg->cpu.af.u8.f.bits.c = false;
+    cpu_set_f(&gg->cpu, cpu_get_f(&gg->cpu) & ~FLAG_C);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 104);
 
@@ -502,7 +601,7 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 169);
 
-    gg->cpu.hl.u16 = 0xC000;
+    set_reg_hl(&gg->cpu, 0xC000);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 171);
 
@@ -668,19 +767,23 @@ int main() {
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 265);
 
-    gg->cpu.bc.u16 = 0xCAFE;
+    set_reg_bc(&gg->cpu, 0xCAFE);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 269);
-    assert(gg->cpu.bc.u8.b == 0xCA);
-    assert(gg->cpu.bc.u8.c == 0xFE);
-    assert(bus_read(&gg->bus, gg->cpu.sp) == gg->cpu.bc.u8.b);
-    assert(bus_read(&gg->bus, gg->cpu.sp + 1) == gg->cpu.bc.u8.c);
+    assert(gg->cpu.regs[REG_B] == 0xCA);
+    assert(gg->cpu.regs[REG_C] == 0xFE);
+    assert(bus_read(&gg->bus, gg->cpu.sp) == gg->cpu.regs[REG_B]);
+    assert(bus_read(&gg->bus, gg->cpu.sp + 1) == gg->cpu.regs[REG_C]);
 
-    gg->cpu.de.u16 = 0x0000;
+    set_reg_de(&gg->cpu, 0x0000);
     cpu_clock(&gg->cpu);
     assert(gg->cpu.clocks == 272);
-    assert(gg->cpu.de.u8.d == gg->cpu.bc.u8.b);
-    assert(gg->cpu.de.u8.e == gg->cpu.bc.u8.c);
+    assert(gg->cpu.regs[REG_D] == gg->cpu.regs[REG_B]);
+    assert(gg->cpu.regs[REG_E] == gg->cpu.regs[REG_C]);
+
+    test_flags();
+    test_branches();
 
     printf("Test: test_cpu passed!\n");
+    return 0;
 }
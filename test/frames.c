@@ -0,0 +1,93 @@
+#define _POSIX_C_SOURCE 199506L
+#include "src/frames.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRESS_FRAMES 20000
+
+/* Set by the producer once it published its last frame */
+bool produced = false;
+
+void test_handoff() {
+    frame_queue *q = malloc(sizeof(frame_queue));
+    uint8_t(*first)[WIDTH];
+
+    *q = frame_queue_new();
+    assert(!frame_queue_acquire(q));
+
+    first = frame_queue_back(q);
+    memset(first, 1, sizeof(q->buffers[0]));
+    frame_queue_publish(q);
+    assert(frame_queue_back(q) != first);
+    assert(frame_queue_acquire(q));
+    assert(frame_queue_front(q)[HEIGHT - 1][WIDTH - 1] == 1);
+    assert(!frame_queue_acquire(q));
+
+    /* Only the newest of several frames is seen, the older ones are dropped */
+    memset(frame_queue_back(q), 2, sizeof(q->buffers[0]));
+    frame_queue_publish(q);
+    memset(frame_queue_back(q), 3, sizeof(q->buffers[0]));
+    frame_queue_publish(q);
+    /* The producer never gets the front buffer back */
+    assert((const void *)frame_queue_back(q) != (const void *)frame_queue_front(q));
+    assert(frame_queue_acquire(q));
+    assert(frame_queue_front(q)[0][0] == 3);
+    assert(!frame_queue_acquire(q));
+
+    free(q);
+}
+
+/* Every frame is filled with its number, a torn frame would mix two of them */
+void *produce(void *arg) {
+    frame_queue *q = arg;
+    uintptr_t i;
+    for (i = 1; i <= STRESS_FRAMES; i++) {
+        memset(frame_queue_back(q), i & 0xFF, sizeof(q->buffers[0]));
+        frame_queue_publish(q);
+    }
+    __atomic_store_n(&produced, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void test_threads() {
+    frame_queue *q = malloc(sizeof(frame_queue));
+    pthread_t thread;
+    uint8_t last = 0;
+    uintptr_t seen = 0;
+    uint16_t y;
+    uint8_t x;
+
+    *q = frame_queue_new();
+    assert(pthread_create(&thread, NULL, produce, q) == 0);
+    for (;;) {
+        bool done = __atomic_load_n(&produced, __ATOMIC_ACQUIRE);
+        const uint8_t(*front)[WIDTH];
+        if (!frame_queue_acquire(q)) {
+            if (done)
+                break;
+            continue;
+        }
+        front = frame_queue_front(q);
+        for (y = 0; y < HEIGHT; y++)
+            for (x = 0; x < WIDTH; x++)
+                assert(front[y][x] == front[0][0]);
+        last = front[0][0];
+        seen++;
+    }
+    pthread_join(thread, NULL);
+    /* The last frame is never dropped */
+    assert(last == (STRESS_FRAMES & 0xFF));
+    printf("Frames seen: %lu of %u\n", (unsigned long)seen, STRESS_FRAMES);
+
+    free(q);
+}
+
+int main() {
+    test_handoff();
+    test_threads();
+    printf("Test: test_frames passed!\n");
+    return 0;
+}
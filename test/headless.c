@@ -0,0 +1,86 @@
+#include "src/savestate.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_PATH "headless_test.state"
+#define OUT_PREFIX "headless_test"
+#define FRAMES 10
+#define COMMAND_LEN 4096
+
+/* clang-format off */
+/* Sleeps in HALT until VBlank every frame, like most games do */
+const uint8_t HALT_PROGRAM[] = {
+    0xFB,       /* 0xC000: EI      */
+    0x76,       /* 0xC001: HALT    */
+    0x18, 0xFC, /* 0xC002: JR -4   */
+};
+const uint8_t STOP_PROGRAM[] = {
+    0x10, 0x00, /* 0xC000: STOP    */
+};
+/* clang-format on */
+
+/* Saves a machine about to run program from work RAM, with VBlank enabled */
+void save_program(const uint8_t *program, size_t len) {
+    gamegirl *gg = gamegirl_init(NULL);
+    size_t i;
+
+    bus_write(&gg->bus, 0xFF50, 0x01);
+    for (i = 0; i < len; i++)
+        bus_write(&gg->bus, 0xC000 + i, program[i]);
+    bus_write(&gg->bus, 0xFFFF, INT_VBLANK);
+    gg->cpu.pc = 0xC000;
+    gg->cpu.sp = 0xDFF0;
+    assert(savestate_save_file(gg, STATE_PATH));
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Runs the headless runner on the saved state, which it saves again when done */
+int run_headless(char *headless) {
+    char command[COMMAND_LEN];
+    sprintf(command, "%.*s -f %d -o %s -l %s -s %s", COMMAND_LEN / 2, headless, FRAMES,
+            OUT_PREFIX, STATE_PATH, STATE_PATH);
+    return system(command);
+}
+
+/* A halted CPU is woken up by VBlank every frame, so the runner keeps going until the end */
+void test_halt(char *headless) {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    save_program(HALT_PROGRAM, sizeof(HALT_PROGRAM));
+    assert(run_headless(headless) == 0);
+    assert(savestate_load_file(gg, STATE_PATH));
+    assert(gg->ppu.frames == FRAMES);
+    assert(gg->cpu.pc >= 0xC000 && gg->cpu.pc < 0xC000 + sizeof(HALT_PROGRAM));
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Nothing wakes a stopped CPU up, so the runner gives up and says so */
+void test_stop(char *headless) {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    save_program(STOP_PROGRAM, sizeof(STOP_PROGRAM));
+    assert(run_headless(headless) != 0);
+    assert(savestate_load_file(gg, STATE_PATH));
+    assert(gg->cpu.mode == cpu_stop_mode_e);
+    assert(gg->ppu.frames == 0);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main(int argc, char **argv) {
+    assert(argc == 2);
+    test_halt(argv[1]);
+    test_stop(argv[1]);
+    remove(STATE_PATH);
+    remove(OUT_PREFIX ".pgm");
+    remove(OUT_PREFIX ".txt");
+    printf("Test: test_headless passed!\n");
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include "src/block.h"
+#include "src/gameboy.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMES 5
+
+/* clang-format off */
+const uint8_t TEST_PROGRAM[] = {
+    0xFB,       /* 0xC000: EI      */
+    0x04,       /* 0xC001: INC B   */
+    0x04,       /* 0xC002: INC B   */
+    0xF3,       /* 0xC003: DI      */
+    0x76,       /* 0xC004: HALT    */
+    0x0C,       /* 0xC005: INC C   */
+    0xFB,       /* 0xC006: EI      */
+    0x76,       /* 0xC007: HALT    */
+    0x18, 0xFC, /* 0xC008: JR -4   */
+};
+/* clang-format on */
+
+/* VBlank increments D and STAT increments E */
+const uint8_t VBLANK_HANDLER[] = {0x14, 0xD9}; /* INC D / RETI */
+const uint8_t STAT_HANDLER[] = {0x1C, 0xD9};   /* INC E / RETI */
+
+gamegirl *setup() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint16_t i;
+
+    memcpy(&gg->bus.cart.data[INT_VECTOR_START], VBLANK_HANDLER, sizeof(VBLANK_HANDLER));
+    memcpy(&gg->bus.cart.data[INT_VECTOR_START + INT_VECTOR_SIZE], STAT_HANDLER,
+           sizeof(STAT_HANDLER));
+    bus_write(&gg->bus, 0xFF50, 0x01);
+    for (i = 0; i < sizeof(TEST_PROGRAM); i++)
+        bus_write(&gg->bus, 0xC000 + i, TEST_PROGRAM[i]);
+    gg->cpu.pc = 0xC000;
+    gg->cpu.sp = 0xDFF0;
+    return gg;
+}
+
+void test_dispatch() {
+    gamegirl *gg = setup();
+    uintptr_t clocks;
+
+    bus_write(&gg->bus, 0xFF0F, INT_VBLANK | INT_STAT);
+    bus_write(&gg->bus, 0xFFFF, INT_VBLANK | INT_STAT);
+
+    /* EI only takes effect after the next instruction */
+    cpu_clock(&gg->cpu);
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.pc == 0xC002);
+    assert(gg->cpu.regs[REG_B] == 1);
+
+    /* VBlank goes first, acknowledged and with IME cleared, and its handler starts right away */
+    clocks = cpu_clock(&gg->cpu);
+    assert(clocks == (uintptr_t)CLOCKS_PER_INTERRUPT + CPU_OPS[0x14].clocks);
+    assert(gg->cpu.pc == INT_VECTOR_START + 1);
+    assert(gg->cpu.sp == 0xDFEE);
+    assert(gg->cpu.regs[REG_D] == 1);
+    assert(!gg->cpu.ime);
+    assert(bus_read(&gg->bus, 0xFF0F) == INT_STAT);
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.pc == 0xC002);
+    assert(gg->cpu.ime);
+
+    /* RETI enables interrupts at once, STAT is next */
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.pc == INT_VECTOR_START + INT_VECTOR_SIZE + 1);
+    assert(gg->cpu.regs[REG_E] == 1);
+    assert(bus_read(&gg->bus, 0xFF0F) == 0);
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.pc == 0xC002);
+
+    /* With IME cleared a pending interrupt ends HALT without being taken */
+    cpu_clock(&gg->cpu);
+    cpu_clock(&gg->cpu);
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.regs[REG_B] == 2);
+    assert(gg->cpu.mode == cpu_halted_mode_e);
+    assert(cpu_clock(&gg->cpu) == 1);
+    bus_write(&gg->bus, 0xFF0F, INT_STAT);
+    cpu_clock(&gg->cpu);
+    assert(gg->cpu.mode == cpu_running_mode_e);
+    assert(gg->cpu.regs[REG_C] == 1);
+    assert(gg->cpu.regs[REG_E] == 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* STAT writes only reach the interrupt sources, LY can't be written at all */
+void test_stat_write() {
+    gamegirl *gg = setup();
+
+    bus_write(&gg->bus, 0xFF45, 2);
+    while (*gg->ppu.ly != 2 || gg->ppu.lcds->state != draw_state_e)
+        ppu_clock(&gg->ppu);
+
+    bus_write(&gg->bus, 0xFF41, 0x00);
+    assert(bus_read(&gg->bus, 0xFF41) == 0x07);
+    bus_write(&gg->bus, 0xFF41, 0xF8);
+    assert(bus_read(&gg->bus, 0xFF41) == 0x7F);
+    bus_write(&gg->bus, 0xFF44, 0x50);
+    assert(bus_read(&gg->bus, 0xFF44) == 2);
+
+    /* The draw state still ends into HBlank, with its interrupt now enabled */
+    bus_write(&gg->bus, 0xFF0F, 0);
+    while (gg->ppu.lcds->state == draw_state_e)
+        ppu_clock(&gg->ppu);
+    assert(gg->ppu.lcds->state == hblank_state_e);
+    assert((bus_read(&gg->bus, 0xFF41) & 0x07) == 0x04);
+    assert(bus_read(&gg->bus, 0xFF0F) & INT_STAT);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* A halted CPU skips ahead to the next event, and wakes up once every frame for VBlank */
+void test_halt(bool blocks) {
+    gamegirl *gg = setup();
+    int steps = 0;
+
+    if (!blocks) {
+        block_cache_free(gg->cpu.blocks);
+        gg->cpu.blocks = NULL;
+    }
+    bus_write(&gg->bus, 0xFFFF, INT_VBLANK);
+    gg->cpu.pc = 0xC006;
+    while (gg->ppu.frames < FRAMES) {
+        gamegirl_clock(gg);
+        steps++;
+    }
+    /* The interrupt for the frame that just ended has yet to be taken */
+    assert(gg->cpu.regs[REG_D] == FRAMES - 1);
+    assert(gg->cpu.mode == cpu_halted_mode_e);
+    /* Only the PPU's state transitions, four per line, are stepped through */
+#ifdef PPU_FIFO
+    /* And every clock of the draw state, which the FIFO takes one clock at a time */
+    assert(steps <= FRAMES * ((LAST_LINE + 1) * 4 + HEIGHT * CLOCKS_PER_DRAW));
+#else
+    assert(steps <= FRAMES * (LAST_LINE + 1) * 4);
+#endif
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main() {
+    test_dispatch();
+    test_stat_write();
+    test_halt(true);
+    test_halt(false);
+    printf("Test: test_interrupt passed!\n");
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include "src/block.h"
+#include "src/decoder.h"
+#include "src/savestate.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROM_PATH "jit_test.gb"
+#define ROM_SIZE 0x8000
+/* Four banks behind an MBC1 */
+#define MAP_ROM_SIZE 0x10000
+#define SEEDS 4
+#define BLOCKS 64
+#define CHECK_STEPS 500
+#define RUN_STEPS 20000
+
+#define CODE_START 0x0200
+#define SUBROUTINE 0x0150
+
+/*
+ * Opcodes random blocks are built from. Branches are appended separately, and anything that could
+ * move H, B, D or SP out of work RAM is left out, so every memory access stays harmless.
+ */
+bool random_op_allowed(uint8_t op) {
+    uint8_t hi = op >> 4;
+    uint8_t lo = op & 0x0F;
+    /* LD B/D/H, r and LD r, r in general are fine apart from those destinations */
+    if (op >= 0x40 && op <= 0x67)
+        return (op >= 0x48 && op <= 0x4F) || (op >= 0x58 && op <= 0x5F);
+    if (op >= 0x68 && op <= 0xBF)
+        return op != 0x76;
+    if (op < 0x40) {
+        /* Column 0 and 8 are branches, SP loads and stop, 3/9/B touch the register pairs */
+        if (lo == 0x00 || lo == 0x08 || lo == 0x03 || lo == 0x09 || lo == 0x0B)
+            return false;
+        /* LD BC/DE/HL, nn get their high byte pointed at work RAM below */
+        if (lo == 0x01)
+            return hi <= 2;
+        /* INC, DEC and LD n of B, D and H */
+        if ((lo == 0x04 || lo == 0x05 || lo == 0x06) && hi <= 2)
+            return false;
+        /* LD (HL+/-) walks HL out of work RAM */
+        if (lo == 0x02 || lo == 0x0A)
+            return hi <= 1;
+        return true;
+    }
+    switch (op) {
+    case 0xC6:
+    case 0xCE:
+    case 0xD6:
+    case 0xDE:
+    case 0xE6:
+    case 0xEE:
+    case 0xF6:
+    case 0xFE:
+    case 0xE0:
+    case 0xE2:
+    case 0xEA:
+    case 0xF0:
+    case 0xF2:
+    case 0xFA:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t next_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+/* Straight line runs of random ops, each ending in one of the branches the JIT translates */
+void write_rom(uint32_t seed) {
+    uint8_t *rom = calloc(ROM_SIZE, 1);
+    uint16_t pc = CODE_START;
+    uint16_t next;
+    uint16_t i;
+    FILE *f;
+
+    /* LD H, 0xC0 / LD B, 0xC1 / LD D, 0xC2 / LD SP, 0xDFF0 / JP CODE_START */
+    const uint8_t init[] = {0x26, 0xC0, 0x06, 0xC1, 0x16, 0xC2, 0x31, 0xF0, 0xDF, 0xC3, 0x00, 0x02};
+    memcpy(&rom[0x0100], init, sizeof(init));
+    rom[SUBROUTINE] = 0xC9; /* RET */
+
+    for (i = 0; i < BLOCKS; i++) {
+        uint32_t n = 1 + next_random(&seed) % 12;
+        while (n > 0) {
+            uint8_t op = next_random(&seed);
+            if (op == 0xCB) {
+                uint8_t cb = next_random(&seed);
+                /* Leaves B, D and H alone */
+                if ((cb & 0x07) == 0 || (cb & 0x07) == 2 || (cb & 0x07) == 4)
+                    continue;
+                rom[pc++] = 0xCB;
+                rom[pc++] = cb;
+            } else if (random_op_allowed(op)) {
+                uint8_t length = OP_TABLE[op].length;
+                rom[pc] = op;
+                rom[pc + 1] = next_random(&seed);
+                rom[pc + 2] = next_random(&seed);
+                /* Absolute addresses in work RAM, high page ones in HRAM */
+                if (op == 0xEA || op == 0xFA)
+                    rom[pc + 2] = 0xC0 | (rom[pc + 2] & 0x1F);
+                else if (op == 0x01 || op == 0x11 || op == 0x21)
+                    rom[pc + 2] = 0xC0 | (rom[pc + 2] & 0x03);
+                else if (op == 0xE0 || op == 0xF0)
+                    rom[pc + 1] |= 0x80;
+                pc += length;
+            } else {
+                continue;
+            }
+            n--;
+        }
+        /* Taken and not taken branches go to the next block alike, only their timing differs */
+        next = pc + 3;
+        switch (next_random(&seed) % 6) {
+        case 0:
+            rom[pc++] = 0x18; /* JR +0 */
+            rom[pc++] = 0x00;
+            break;
+        case 1:
+            rom[pc++] = 0x20 | (next_random(&seed) % 4) << 3; /* JR cc, +0 */
+            rom[pc++] = 0x00;
+            break;
+        case 2:
+            rom[pc++] = 0xC3; /* JP next */
+            rom[pc++] = next & 0xFF;
+            rom[pc++] = next >> 8;
+            break;
+        case 3:
+            rom[pc++] = 0xC2 | (next_random(&seed) % 4) << 3; /* JP cc, next */
+            rom[pc++] = next & 0xFF;
+            rom[pc++] = next >> 8;
+            break;
+        case 4:
+            rom[pc++] = 0xCD; /* CALL SUBROUTINE */
+            rom[pc++] = SUBROUTINE & 0xFF;
+            rom[pc++] = SUBROUTINE >> 8;
+            break;
+        default:
+            /* Falls through into the next block */
+            break;
+        }
+    }
+    rom[pc++] = 0xC3; /* JP CODE_START */
+    rom[pc++] = CODE_START & 0xFF;
+    rom[pc++] = CODE_START >> 8;
+
+    f = fopen(ROM_PATH, "wb");
+    assert(f != NULL);
+    assert(fwrite(rom, 1, ROM_SIZE, f) == ROM_SIZE);
+    fclose(f);
+    free(rom);
+}
+
+/*
+ * SET and RES through HL at IF, IE and the MBC bank register, each ending the block in the
+ * interpreter: an interrupt becomes pending, or the bank read right after changes.
+ */
+void write_map_rom() {
+    uint8_t *rom = calloc(MAP_ROM_SIZE, 1);
+    uint8_t bank;
+    FILE *f;
+
+    /* clang-format off */
+    /* LD SP, 0xDFF0 / EI / JP 0x0200 */
+    const uint8_t init[] = {0x31, 0xF0, 0xDF, 0xFB, 0xC3, 0x00, 0x02};
+    /* INC C / LD HL, 0xFFFF / RES 0, (HL) / RETI */
+    const uint8_t handler[] = {0x0C, 0x21, 0xFF, 0xFF, 0xCB, 0x86, 0xD9};
+    const uint8_t loop[] = {
+        0x21, 0x0F, 0xFF, /* LD HL, 0xFF0F */
+        0xCB, 0xC6,       /* SET 0, (HL)   */
+        0xCB, 0x8E,       /* RES 1, (HL)   */
+        0x21, 0xFF, 0xFF, /* LD HL, 0xFFFF */
+        0xCB, 0xC6,       /* SET 0, (HL)   */
+        0x04,             /* INC B         */
+        0x21, 0x00, 0x20, /* LD HL, 0x2000 */
+        0xCB, 0xCE,       /* SET 1, (HL)   */
+        0xFA, 0x00, 0x40, /* LD A, (0x4000) */
+        0x5F,             /* LD E, A       */
+        0xCB, 0x8E,       /* RES 1, (HL)   */
+        0xFA, 0x00, 0x40, /* LD A, (0x4000) */
+        0x57,             /* LD D, A       */
+        0xC3, 0x00, 0x02, /* JP 0x0200     */
+    };
+    /* clang-format on */
+
+    memcpy(&rom[0x0100], init, sizeof(init));
+    memcpy(&rom[INT_VECTOR_START], handler, sizeof(handler));
+    memcpy(&rom[CODE_START], loop, sizeof(loop));
+    rom[CART_TYPE_ADDR] = 0x01;
+    /* ROM size code for 64 KiB */
+    rom[0x0148] = 0x01;
+    for (bank = 1; bank < MAP_ROM_SIZE / ROM_BANK_SIZE; bank++)
+        rom[bank * ROM_BANK_SIZE] = bank;
+
+    f = fopen(ROM_PATH, "wb");
+    assert(f != NULL);
+    assert(fwrite(rom, 1, MAP_ROM_SIZE, f) == MAP_ROM_SIZE);
+    fclose(f);
+    free(rom);
+}
+
+/* Runs a translating machine next to a purely interpreted one, comparing them as they go */
+int run_lockstep(char *path, bool skip_boot) {
+    gamegirl *gg = gamegirl_init(path);
+    gamegirl *interpreted = gamegirl_init(path);
+    size_t len = savestate_size(gg);
+    uint8_t *expected = malloc(len);
+    uint8_t *actual = malloc(len);
+    int translated = 0;
+    int i;
+
+    block_cache_free(interpreted->cpu.blocks);
+    interpreted->cpu.blocks = NULL;
+    if (skip_boot) {
+        bus_write(&gg->bus, 0xFF50, 0x01);
+        bus_write(&interpreted->bus, 0xFF50, 0x01);
+        gg->cpu.pc = 0x0100;
+        interpreted->cpu.pc = 0x0100;
+    }
+
+    for (i = 1; i <= RUN_STEPS; i++) {
+        gamegirl_clock(gg);
+        gamegirl_clock(interpreted);
+        if (i % CHECK_STEPS != 0)
+            continue;
+        savestate_save(gg, expected, len);
+        savestate_save(interpreted, actual, len);
+        assert(memcmp(expected, actual, len) == 0);
+    }
+    for (i = 0; i < BLOCK_CACHE_SIZE; i++)
+        translated += gg->cpu.blocks->blocks[i].native != NULL;
+
+    gamegirl_free(interpreted);
+    free(interpreted);
+    gamegirl_free(gg);
+    free(gg);
+    free(expected);
+    free(actual);
+    return translated;
+}
+
+int main() {
+    uint32_t seed;
+
+    /* The embedded cpu_instrs ROM, starting from the boot ROM */
+    assert(run_lockstep(NULL, false) > 0);
+    for (seed = 1; seed <= SEEDS; seed++) {
+        write_rom(seed);
+        assert(run_lockstep(ROM_PATH, true) > 0);
+    }
+    write_map_rom();
+    assert(run_lockstep(ROM_PATH, true) > 0);
+    remove(ROM_PATH);
+    printf("Test: test_jit passed!\n");
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "src/pixel.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Long enough for every vector width, odd so the tails are exercised too */
+#define ROWS 77
+#define PIXELS (ROWS * 8)
+
+const uint32_t COLORS[4] = {0xFFFFFFFF, 0xFFCCCCCC, 0xFF777777, 0xFF000000};
+
+/* Every set the host supports must match the scalar one */
+void test_kernels(const pixel_kernels *impl) {
+    const pixel_kernels *scalar = &PIXEL_IMPLS[0];
+    uint8_t planes[ROWS * 2];
+    uint8_t expected[PIXELS];
+    uint8_t actual[PIXELS];
+    uint32_t expected_colors[PIXELS];
+    uint32_t actual_colors[PIXELS];
+    uint16_t palette;
+    uint16_t n;
+    uint16_t i;
+
+    for (i = 0; i < sizeof(planes); i++)
+        planes[i] = rand();
+
+    for (n = 0; n <= ROWS; n += 3) {
+        memset(actual, 0xAA, sizeof(actual));
+        scalar->decode_rows(planes, expected, n);
+        impl->decode_rows(planes, actual, n);
+        assert(memcmp(actual, expected, n * 8) == 0);
+        assert(actual[n * 8] == 0xAA || n == ROWS);
+    }
+    scalar->decode_rows(planes, expected, ROWS);
+    memcpy(actual, expected, sizeof(actual));
+    for (palette = 0; palette < 0x100; palette += 0x1B)
+        for (n = 0; n <= PIXELS; n += 37) {
+            uint8_t table[4];
+            uint8_t shades[PIXELS];
+            for (i = 0; i < 4; i++)
+                table[i] = (palette >> (i * 2)) & 0x03;
+            scalar->map_palette(actual, expected, n, table);
+            impl->map_palette(actual, shades, n, table);
+            assert(memcmp(shades, expected, n) == 0);
+        }
+
+    for (n = 0; n <= PIXELS; n += 37) {
+        scalar->expand(actual, expected_colors, n, COLORS);
+        impl->expand(actual, actual_colors, n, COLORS);
+        assert(memcmp(actual_colors, expected_colors, n * sizeof(uint32_t)) == 0);
+    }
+}
+
+void test_decode() {
+    const uint8_t planes[2] = {0x3C, 0x7E};
+    const uint8_t expected[8] = {0, 2, 3, 3, 3, 3, 2, 0};
+    uint8_t row[8];
+
+    PIXEL_IMPLS[0].decode_rows(planes, row, 1);
+    assert(memcmp(row, expected, 8) == 0);
+}
+
+int main() {
+    uint8_t i;
+    test_decode();
+    for (i = 0; i < PIXEL_IMPL_COUNT; i++) {
+        if (!PIXEL_IMPLS[i].supported())
+            continue;
+        test_kernels(&PIXEL_IMPLS[i]);
+        printf("Kernels: %s\n", PIXEL_IMPLS[i].name);
+    }
+    printf("Test: test_pixel passed!\n");
+    return 0;
+}
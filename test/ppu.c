@@ -0,0 +1,126 @@
+#include "test/ppu_common.h"
+#include <stdio.h>
+#include <string.h>
+
+/* LD B, 0x11 / JR -2 */
+const uint8_t TEST_PROGRAM[] = {0x06, 0x11, 0x18, 0xFE};
+
+void test_decode() {
+    gamegirl *gg = gamegirl_init(NULL);
+    const uint8_t expected[8] = {0, 2, 3, 3, 3, 3, 2, 0};
+    uint16_t i;
+
+    bus_write(&gg->bus, 0x8010, 0x3C);
+    bus_write(&gg->bus, 0x8011, 0x7E);
+    assert(memcmp(gg->bus.tiles[1][0], expected, 8) == 0);
+
+    /* Memory modified behind the bus' back is decoded on request */
+    for (i = 0; i < TILE_SIZE; i++)
+        gg->bus.vram[TILE_SIZE * (TILE_COUNT - 1) + i] = 0xFF;
+    assert(gg->bus.tiles[TILE_COUNT - 1][7][7] == 0);
+    bus_decode_tiles(&gg->bus);
+    assert(gg->bus.tiles[TILE_COUNT - 1][7][7] == 3);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Palette tables follow every write to their register */
+void test_palettes() {
+    gamegirl *gg = gamegirl_init(NULL);
+    const uint8_t expected[4] = {3, 2, 1, 0};
+
+    bus_write(&gg->bus, OBP1, 0x1B);
+    assert(memcmp(gg->bus.palettes[PALETTE_OBP1], expected, 4) == 0);
+    assert(gg->bus.palettes[PALETTE_OBP0][3] == 0);
+
+    /* Registers modified behind the bus' back are decoded on request */
+    gg->bus.io[BGP - IO_START] = 0x1B;
+    bus_decode_palettes(&gg->bus);
+    assert(memcmp(gg->bus.palettes[PALETTE_BGP], expected, 4) == 0);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+void test_render() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint8_t x;
+
+    fill_tile(gg, 1, 1);
+    fill_tile(gg, 2, 2);
+    /* Tile number 1 in the signed half of the tile data */
+    fill_tile(gg, 0x101, 3);
+    fill_map(gg, 0x9800, 1);
+    fill_map(gg, 0x9C00, 2);
+    bus_write(&gg->bus, BGP, 0xE4);
+    *gg->ppu.ly = 0;
+
+    /* Tile numbers are unsigned from 0x8000 */
+    bus_write(&gg->bus, LCDC, 0x91);
+    ppu_draw_scanline(&gg->ppu);
+    for (x = 0; x < WIDTH; x++)
+        assert(gg->ppu.framebuffer[0][x] == 1);
+
+    /* Or signed from 0x9000 */
+    bus_write(&gg->bus, LCDC, 0x81);
+    ppu_draw_scanline(&gg->ppu);
+    for (x = 0; x < WIDTH; x++)
+        assert(gg->ppu.framebuffer[0][x] == 3);
+
+    /* The window covers the rest of the line from window_x - 7 */
+    bus_write(&gg->bus, WY, 0);
+    bus_write(&gg->bus, WX, 7 + 80);
+    bus_write(&gg->bus, LCDC, 0xF1);
+    ppu_draw_scanline(&gg->ppu);
+    for (x = 0; x < WIDTH; x++)
+        assert(gg->ppu.framebuffer[0][x] == (x < 80 ? 1 : 2));
+    bus_write(&gg->bus, WY, 1);
+    ppu_draw_scanline(&gg->ppu);
+    assert(gg->ppu.framebuffer[0][WIDTH - 1] == 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+void draw_line(gamegirl *gg, uint8_t ly) {
+    *gg->ppu.ly = ly;
+    ppu_scan_oam(&gg->ppu);
+    ppu_draw_scanline(&gg->ppu);
+}
+
+/* Tile data is always written through the slow path, code in it is still invalidated */
+void test_code() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint16_t i;
+
+    for (i = 0; i < sizeof(TEST_PROGRAM); i++)
+        bus_write(&gg->bus, 0x8100 + i, TEST_PROGRAM[i]);
+    gg->cpu.pc = 0x8100;
+    cpu_run(&gg->cpu, gg->cpu.clocks + 64);
+    assert(gg->cpu.regs[REG_B] == 0x11);
+
+    bus_write(&gg->bus, 0x8101, 0x22);
+    assert(gg->bus.tiles[0x10][0][5] == 1 && gg->bus.tiles[0x10][0][6] == 3);
+    gg->cpu.pc = 0x8100;
+    cpu_run(&gg->cpu, gg->cpu.clocks + 64);
+    assert(gg->cpu.regs[REG_B] == 0x22);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main() {
+    test_decode();
+    test_palettes();
+    test_render();
+    test_scroll(draw_line);
+    test_obj_scan(draw_line);
+    test_obj_priority(draw_line);
+    test_obj_pixels(draw_line);
+    test_raster();
+    test_code();
+    test_render_ratio();
+    printf("Test: test_ppu passed!\n");
+    return 0;
+}
@@ -0,0 +1,311 @@
+#ifndef TEST_PPU_COMMON_H
+#define TEST_PPU_COMMON_H
+
+#include "src/gameboy.h"
+#include <assert.h>
+#include <stdlib.h>
+
+/*
+ * Fixtures and checks shared by the tests of both PPU engines. Checks that look at single lines
+ * take the function drawing line ly of the engine under test, everything else only goes through
+ * the bus and ppu_clock.
+ */
+
+#define LCDC 0xFF40
+#define SCY 0xFF42
+#define SCX 0xFF43
+#define DMA 0xFF46
+#define BGP 0xFF47
+#define OBP0 0xFF48
+#define OBP1 0xFF49
+#define WY 0xFF4A
+#define WX 0xFF4B
+
+/* Scans OAM for and draws line ly, the first line of a frame starts it */
+typedef void (*draw_line_fn)(gamegirl *gg, uint8_t ly);
+
+/* Fills tile n of the tiles at 0x8000 with colour index color */
+void fill_tile(gamegirl *gg, uint16_t n, uint8_t color) {
+    uint8_t i;
+    for (i = 0; i < TILE_SIZE; i += 2) {
+        bus_write(&gg->bus, VRAM_START + n * TILE_SIZE + i, color & 1 ? 0xFF : 0x00);
+        bus_write(&gg->bus, VRAM_START + n * TILE_SIZE + i + 1, color & 2 ? 0xFF : 0x00);
+    }
+}
+
+void fill_map(gamegirl *gg, uint16_t map, uint8_t n) {
+    uint16_t i;
+    for (i = 0; i < 0x400; i++)
+        bus_write(&gg->bus, map + i, n);
+}
+
+/* Places sprite i with its top left pixel at screen position x, y */
+void set_obj(gamegirl *gg, uint8_t i, uint8_t y, uint8_t x, uint8_t tile, uint8_t attrs) {
+    bus_write(&gg->bus, SAT_START + i * OBJ_SIZE, y + OBJ_Y_OFFSET);
+    bus_write(&gg->bus, SAT_START + i * OBJ_SIZE + 1, x + OBJ_X_OFFSET);
+    bus_write(&gg->bus, SAT_START + i * OBJ_SIZE + 2, tile);
+    bus_write(&gg->bus, SAT_START + i * OBJ_SIZE + 3, attrs);
+}
+
+/* Runs the PPU through every transition due by when and leaves the CPU at when */
+void run_ppu(gamegirl *gg, uintptr_t when) {
+    while (gg->ppu.clocks <= when) {
+        gg->cpu.clocks = gg->ppu.clocks;
+        ppu_clock(&gg->ppu);
+    }
+    gg->cpu.clocks = when;
+}
+
+/* Shade of screen pixel x on line ly looked up one pixel at a time */
+uint8_t reference_pixel(gamegirl *gg, uint8_t x, uint8_t ly) {
+    uint8_t lcdc = bus_read(&gg->bus, LCDC);
+    int16_t window_start = bus_read(&gg->bus, WX) - 7;
+    uint16_t map;
+    uint8_t xpos;
+    uint8_t ypos;
+    uint8_t n;
+    uint16_t tile;
+
+    if ((lcdc & 0x20) && bus_read(&gg->bus, WY) <= ly && x >= window_start) {
+        map = lcdc & 0x40 ? 0x9C00 : 0x9800;
+        xpos = x - window_start;
+        ypos = ly - bus_read(&gg->bus, WY);
+    } else {
+        map = lcdc & 0x08 ? 0x9C00 : 0x9800;
+        xpos = x + bus_read(&gg->bus, SCX);
+        ypos = ly + bus_read(&gg->bus, SCY);
+    }
+    n = bus_read(&gg->bus, map + (ypos / 8) * 32 + xpos / 8);
+    tile = lcdc & 0x10 ? n : 256 + (int8_t)n;
+    return (bus_read(&gg->bus, BGP) >> (gg->bus.tiles[tile][ypos % 8][xpos % 8] * 2)) & 0x03;
+}
+
+/* Every scroll and window position, a whole frame at a time for the window line counter */
+void test_scroll(draw_line_fn draw_line) {
+    static const uint8_t LCDCS[] = {0x91, 0x89, 0xE1, 0xB1};
+    static const uint8_t WXS[] = {0, 3, 7, 8, 100, 166, 167};
+    gamegirl *gg = gamegirl_init(NULL);
+    uint16_t i;
+    uint16_t scroll;
+    uint8_t k;
+    uint8_t w;
+    uint8_t ly;
+    uint8_t x;
+
+    for (i = 0; i < 0x2000; i++)
+        bus_write(&gg->bus, VRAM_START + i, (i * 0x35) ^ (i >> 3));
+    bus_write(&gg->bus, BGP, 0x6C);
+
+    for (k = 0; k < sizeof(LCDCS); k++)
+        for (w = 0; w < sizeof(WXS); w++)
+            for (scroll = 0; scroll < 0x100; scroll += 29) {
+                bus_write(&gg->bus, LCDC, LCDCS[k]);
+                bus_write(&gg->bus, WX, WXS[w]);
+                bus_write(&gg->bus, WY, scroll % 3);
+                bus_write(&gg->bus, SCX, scroll);
+                bus_write(&gg->bus, SCY, scroll * 7);
+                for (ly = 0; ly < HEIGHT; ly++) {
+                    draw_line(gg, ly);
+                    for (x = 0; x < WIDTH; x++)
+                        assert(gg->ppu.framebuffer[ly][x] == reference_pixel(gg, x, ly));
+                }
+            }
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* At most 10 sprites per line in OAM order */
+void test_obj_scan(draw_line_fn draw_line) {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint8_t i;
+
+    fill_tile(gg, 1, 1);
+    fill_tile(gg, 2, 2);
+    fill_tile(gg, 3, 3);
+    bus_write(&gg->bus, BGP, 0xE4);
+    bus_write(&gg->bus, OBP0, 0xE4);
+    bus_write(&gg->bus, LCDC, 0x93);
+
+    set_obj(gg, 0, 10, 20, 1, 0);
+    set_obj(gg, 1, 12, 16, 2, 0);
+    set_obj(gg, 2, 10, 40, 3, 0);
+    set_obj(gg, 3, 10, 40, 1, 0);
+    for (i = 4; i < 12; i++)
+        set_obj(gg, i, 10, 60 + (i - 4) * 8, 3, 0);
+
+    draw_line(gg, 12);
+    assert(gg->ppu.line_obj_count == OBJS_PER_LINE);
+    assert(gg->ppu.framebuffer[12][20] == 2 && gg->ppu.framebuffer[12][24] == 1);
+    assert(gg->ppu.framebuffer[12][40] == 3);
+    assert(gg->ppu.framebuffer[12][100] == 3 && gg->ppu.framebuffer[12][108] == 0);
+    /* Sprite 1 starts two lines below the others */
+    draw_line(gg, 10);
+    assert(gg->ppu.framebuffer[10][16] == 0 && gg->ppu.framebuffer[10][20] == 1);
+
+    /* Moving a sprite off the line makes room for the next one */
+    set_obj(gg, 0, 50, 20, 1, 0);
+    draw_line(gg, 12);
+    assert(gg->ppu.framebuffer[12][24] == 0 && gg->ppu.framebuffer[12][108] == 3);
+    draw_line(gg, 57);
+    assert(gg->ppu.line_obj_count == 1 && gg->ppu.line_objs[0] == 0);
+    draw_line(gg, 58);
+    assert(gg->ppu.line_obj_count == 0);
+    bus_write(&gg->bus, LCDC, 0x97);
+    draw_line(gg, 58);
+    assert(gg->ppu.line_obj_count == 1);
+
+    /* DMA replaces every sprite */
+    for (i = 0; i < SAT_SIZE; i++)
+        bus_write(&gg->bus, RAM_START + i, 0);
+    bus_write(&gg->bus, RAM_START, 30 + OBJ_Y_OFFSET);
+    bus_write(&gg->bus, DMA, RAM_START >> 8);
+    bus_dma_complete(&gg->bus);
+    draw_line(gg, 12);
+    assert(gg->ppu.line_obj_count == 0);
+    draw_line(gg, 30);
+    assert(gg->ppu.line_obj_count == 1 && gg->ppu.line_objs[0] == 0);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* The leftmost sprite is on top, the background shows through index 0 */
+void test_obj_priority(draw_line_fn draw_line) {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    fill_tile(gg, 1, 1);
+    fill_tile(gg, 2, 2);
+    fill_tile(gg, 3, 3);
+    /* Only the top left pixel of tile 4 is set */
+    bus_write(&gg->bus, VRAM_START + 4 * TILE_SIZE, 0x80);
+    bus_write(&gg->bus, VRAM_START + 4 * TILE_SIZE + 1, 0x80);
+    fill_map(gg, 0x9800, 0);
+    bus_write(&gg->bus, 0x9800 + 10 * 32 + 12, 1);
+    bus_write(&gg->bus, BGP, 0xE4);
+    bus_write(&gg->bus, OBP0, 0xE4);
+    bus_write(&gg->bus, LCDC, 0x93);
+
+    set_obj(gg, 0, 80, 20, 2, 0);
+    set_obj(gg, 1, 80, 16, 3, 0);
+    set_obj(gg, 2, 80, 100, 4, 0x20);
+    /* Partly off the left edge */
+    set_obj(gg, 3, 80, -4, 1, 0);
+    draw_line(gg, 80);
+    assert(gg->ppu.framebuffer[80][0] == 1 && gg->ppu.framebuffer[80][4] == 0);
+    assert(gg->ppu.framebuffer[80][16] == 3 && gg->ppu.framebuffer[80][23] == 3);
+    assert(gg->ppu.framebuffer[80][24] == 2 && gg->ppu.framebuffer[80][28] == 0);
+    assert(gg->ppu.framebuffer[80][107] == 3 && gg->ppu.framebuffer[80][100] == 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Flips, transparency and clipping at the screen edges */
+void test_obj_pixels(draw_line_fn draw_line) {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    /* Only the top left pixel of tile 4 is set */
+    bus_write(&gg->bus, VRAM_START + 4 * TILE_SIZE, 0x80);
+    bus_write(&gg->bus, VRAM_START + 4 * TILE_SIZE + 1, 0x80);
+    bus_write(&gg->bus, BGP, 0xE4);
+    /* Index 0 maps to the darkest shade but stays transparent */
+    bus_write(&gg->bus, OBP0, 0xE7);
+    bus_write(&gg->bus, LCDC, 0x93);
+
+    set_obj(gg, 0, 80, 80, 4, 0);
+    draw_line(gg, 80);
+    assert(gg->ppu.framebuffer[80][80] == 3 && gg->ppu.framebuffer[80][81] == 0);
+    set_obj(gg, 0, 80, 80, 4, 0x60);
+    draw_line(gg, 80);
+    assert(gg->ppu.framebuffer[80][80] == 0);
+    draw_line(gg, 87);
+    assert(gg->ppu.framebuffer[87][87] == 3 && gg->ppu.framebuffer[87][86] == 0);
+
+    /* Partly off the left edge */
+    bus_write(&gg->bus, SAT_START + 1, 5);
+    bus_write(&gg->bus, SAT_START + 3, 0x20);
+    draw_line(gg, 80);
+    assert(gg->ppu.framebuffer[80][4] == 3);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Writes while the line is drawn take effect from the pixel being drawn at the time */
+void test_raster() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t start;
+    uint8_t x;
+
+    fill_tile(gg, 1, 1);
+    fill_map(gg, 0x9800, 1);
+    bus_write(&gg->bus, BGP, 0xE4);
+    bus_write(&gg->bus, LCDC, 0x91);
+
+    while (*gg->ppu.ly != 5 || gg->ppu.lcds->state != draw_state_e)
+        run_ppu(gg, gg->ppu.clocks);
+    start = gg->cpu.clocks;
+    /* Index 1 becomes the darkest shade from pixel 28, the background is off from pixel 68 */
+    run_ppu(gg, start + 10);
+    bus_write(&gg->bus, BGP, 0xEC);
+    run_ppu(gg, start + 20);
+    bus_write(&gg->bus, LCDC, 0x90);
+    while (gg->ppu.lcds->state == draw_state_e)
+        run_ppu(gg, gg->ppu.clocks);
+
+    for (x = 0; x < WIDTH; x++)
+        assert(gg->ppu.framebuffer[5][x] == (x < 28 ? 1 : x < 68 ? 3 : 0));
+    assert(gg->bus.raster_count == 0);
+    assert(bus_read(&gg->bus, BGP) == 0xEC && gg->bus.palettes[PALETTE_BGP][1] == 3);
+    assert(bus_read(&gg->bus, LCDC) == 0x90);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Frames that are not drawn keep every effect the CPU can see */
+void test_render_ratio() {
+    gamegirl *drawn = gamegirl_init(NULL);
+    gamegirl *skipped = gamegirl_init(NULL);
+    gamegirl *ggs[2];
+    uint8_t i;
+
+    ggs[0] = drawn;
+    ggs[1] = skipped;
+    for (i = 0; i < 2; i++) {
+        fill_tile(ggs[i], 1, 3);
+        fill_map(ggs[i], 0x9800, 1);
+        bus_write(&ggs[i]->bus, BGP, 0xE4);
+        bus_write(&ggs[i]->bus, SCX, 3);
+        bus_write(&ggs[i]->bus, LCDC, 0x93);
+        set_obj(ggs[i], 0, 20, 20, 1, 0);
+    }
+    skipped->ppu.render_ratio = 0;
+    skipped->ppu.render = false;
+    while (drawn->ppu.frames < 3) {
+        ppu_clock(&drawn->ppu);
+        ppu_clock(&skipped->ppu);
+        assert(drawn->ppu.clocks == skipped->ppu.clocks);
+        assert(bus_read(&drawn->bus, 0xFF41) == bus_read(&skipped->bus, 0xFF41));
+        assert(bus_read(&drawn->bus, 0xFF44) == bus_read(&skipped->bus, 0xFF44));
+        assert(bus_read(&drawn->bus, 0xFF0F) == bus_read(&skipped->bus, 0xFF0F));
+    }
+    assert(drawn->ppu.framebuffer[0][0] == 3 && skipped->ppu.framebuffer[0][0] == 0);
+
+    /* One frame in two, frame 3 is skipped and frame 4 drawn */
+    skipped->ppu.render_ratio = 2;
+    while (skipped->ppu.frames < 4)
+        ppu_clock(&skipped->ppu);
+    assert(skipped->ppu.framebuffer[0][0] == 0);
+    while (skipped->ppu.frames < 5)
+        ppu_clock(&skipped->ppu);
+    assert(skipped->ppu.framebuffer[0][0] == 3);
+
+    gamegirl_free(drawn);
+    free(drawn);
+    gamegirl_free(skipped);
+    free(skipped);
+}
+
+#endif
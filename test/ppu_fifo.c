@@ -0,0 +1,114 @@
+#include "test/ppu_common.h"
+#include <stdio.h>
+
+/* Draws line ly and returns the clocks the draw state lasted */
+uint8_t draw_line_clocks(gamegirl *gg, uint8_t ly) {
+    uint8_t clocks = 1;
+    *gg->ppu.ly = ly;
+    if (ly == 0)
+        ppu_fifo_start_frame(&gg->ppu);
+    ppu_scan_oam(&gg->ppu);
+    ppu_fifo_start_line(&gg->ppu);
+    while (ppu_fifo_step(&gg->ppu))
+        clocks++;
+    return clocks;
+}
+
+void draw_line(gamegirl *gg, uint8_t ly) {
+    draw_line_clocks(gg, ly);
+}
+
+/* The draw state takes 172 dots, more for every pixel dropped or stalled for */
+void test_timing() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uint8_t x;
+
+    fill_tile(gg, 1, 1);
+    fill_map(gg, 0x9800, 1);
+    bus_write(&gg->bus, BGP, 0xE4);
+    bus_write(&gg->bus, OBP0, 0xE4);
+    bus_write(&gg->bus, LCDC, 0x93);
+
+    assert(draw_line_clocks(gg, 0) == CLOCKS_PER_DRAW);
+    assert(gg->ppu.fifo.dots == CLOCKS_PER_DRAW * DOTS_PER_CLOCK);
+    for (x = 0; x < WIDTH; x++)
+        assert(gg->ppu.framebuffer[0][x] == 1);
+    bus_write(&gg->bus, SCX, 3);
+    assert(draw_line_clocks(gg, 0) == CLOCKS_PER_DRAW + 1);
+    assert(gg->ppu.fifo.dots == CLOCKS_PER_DRAW * DOTS_PER_CLOCK + 3);
+    bus_write(&gg->bus, SCX, 0);
+
+    /* A sprite stalls the FIFO while it is fetched */
+    set_obj(gg, 0, 0, 40, 1, 0);
+    assert(draw_line_clocks(gg, 0) > CLOCKS_PER_DRAW);
+    assert(gg->ppu.fifo.dots > CLOCKS_PER_DRAW * DOTS_PER_CLOCK);
+    set_obj(gg, 0, 0, 0, 0, 0);
+    bus_write(&gg->bus, SAT_START, 0);
+
+    /* So does the restart of the fetcher on the window */
+    bus_write(&gg->bus, WY, 0);
+    bus_write(&gg->bus, WX, 7 + 80);
+    bus_write(&gg->bus, LCDC, 0xB1);
+    assert(draw_line_clocks(gg, 0) > CLOCKS_PER_DRAW);
+    assert(gg->ppu.fifo.window_line == 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* A whole line takes as long as ever, HBlank is shortened by the time drawing took */
+void test_line_length() {
+    gamegirl *gg = gamegirl_init(NULL);
+    uintptr_t start = gg->ppu.clocks - CLOCKS_PER_OAM;
+    uintptr_t draw = 0;
+
+    bus_write(&gg->bus, LCDC, 0x93);
+    bus_write(&gg->bus, SCX, 5);
+    set_obj(gg, 0, 0, 20, 0, 0);
+    while (*gg->ppu.ly == 0) {
+        if (gg->ppu.lcds->state == draw_state_e)
+            draw++;
+        ppu_clock(&gg->ppu);
+    }
+    assert(gg->ppu.clocks - start == CLOCKS_PER_VBLANK + CLOCKS_PER_OAM);
+    assert(draw > CLOCKS_PER_DRAW + 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Sprites with bg_over are behind background pixels other than index 0 */
+void test_obj_bg_over() {
+    gamegirl *gg = gamegirl_init(NULL);
+
+    fill_tile(gg, 1, 1);
+    fill_tile(gg, 3, 3);
+    fill_map(gg, 0x9800, 0);
+    bus_write(&gg->bus, 0x9800 + 10 * 32 + 12, 1);
+    bus_write(&gg->bus, BGP, 0xE4);
+    bus_write(&gg->bus, OBP0, 0xE4);
+    bus_write(&gg->bus, LCDC, 0x93);
+
+    set_obj(gg, 0, 80, 92, 3, 0x80);
+    set_obj(gg, 1, 80, 100, 3, 0x80);
+    draw_line(gg, 80);
+    assert(gg->ppu.framebuffer[80][95] == 3 && gg->ppu.framebuffer[80][96] == 1);
+    assert(gg->ppu.framebuffer[80][100] == 1 && gg->ppu.framebuffer[80][104] == 3);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main() {
+    test_timing();
+    test_line_length();
+    test_scroll(draw_line);
+    test_obj_scan(draw_line);
+    test_obj_priority(draw_line);
+    test_obj_pixels(draw_line);
+    test_obj_bg_over();
+    test_raster();
+    test_render_ratio();
+    printf("Test: test_ppu_fifo passed!\n");
+    return 0;
+}
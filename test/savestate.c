@@ -0,0 +1,64 @@
+#include "src/savestate.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WARMUP_STEPS 5000
+#define RUN_STEPS 20000
+
+int main() {
+    gamegirl *gg = gamegirl_init(NULL);
+    gamegirl *clone;
+    gamegirl *restored;
+    size_t len;
+    uint8_t *expected;
+    uint8_t *actual;
+    int i;
+
+    for (i = 0; i < WARMUP_STEPS; i++)
+        gamegirl_clock(gg);
+    len = savestate_size(gg);
+    expected = malloc(len);
+    actual = malloc(len);
+    assert(savestate_save(gg, expected, len - 1) == 0);
+    assert(savestate_save(gg, expected, len) == len);
+
+    /* Truncated or corrupted states are rejected */
+    restored = gamegirl_init(NULL);
+    assert(!savestate_load(restored, expected, len - 1));
+    expected[0] ^= 0xFF;
+    assert(!savestate_load(restored, expected, len));
+    expected[0] ^= 0xFF;
+    assert(savestate_load(restored, expected, len));
+    clone = gamegirl_clone(gg);
+
+    /* Internal pointers follow the copy instead of the original */
+    assert(clone->cpu.bus == &clone->bus);
+    assert(clone->bus.sched == &clone->sched);
+    assert(clone->ppu.ly == &clone->bus.io[0x44]);
+    assert(clone->bus.read_map[0xC0] == clone->bus.ram);
+
+    /* All three machines stay in lockstep */
+    for (i = 0; i < RUN_STEPS; i++) {
+        gamegirl_clock(gg);
+        gamegirl_clock(clone);
+        gamegirl_clock(restored);
+    }
+    savestate_save(gg, expected, len);
+    savestate_save(clone, actual, len);
+    assert(memcmp(expected, actual, len) == 0);
+    savestate_save(restored, actual, len);
+    assert(memcmp(expected, actual, len) == 0);
+
+    gamegirl_free(clone);
+    free(clone);
+    gamegirl_free(restored);
+    free(restored);
+    gamegirl_free(gg);
+    free(gg);
+    free(expected);
+    free(actual);
+    printf("Test: test_savestate passed!\n");
+    return 0;
+}
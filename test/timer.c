@@ -0,0 +1,153 @@
+#include "src/gameboy.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIV 0xFF04
+#define TIMA 0xFF05
+#define TMA 0xFF06
+#define TAC 0xFF07
+#define IF 0xFF0F
+
+/* clang-format off */
+const uint8_t TEST_PROGRAM[] = {
+    0xFB,       /* 0xC000: EI      */
+    0x76,       /* 0xC001: HALT    */
+    0x18, 0xFC, /* 0xC002: JR -4   */
+};
+/* clang-format on */
+
+/* INC D / RETI */
+const uint8_t TIMER_HANDLER[] = {0x14, 0xD9};
+
+gamegirl *setup() {
+    gamegirl *gg = gamegirl_init(NULL);
+    bus_write(&gg->bus, 0xFF50, 0x01);
+    return gg;
+}
+
+void advance(gamegirl *gg, uintptr_t clocks) {
+    gg->cpu.clocks += clocks;
+}
+
+void test_div() {
+    gamegirl *gg = setup();
+
+    advance(gg, CLOCKS_PER_DIV * 5 + 10);
+    assert(bus_read(&gg->bus, DIV) == 5);
+    advance(gg, CLOCKS_PER_DIV * 0x100);
+    assert(bus_read(&gg->bus, DIV) == 5);
+
+    /* Any write resets the whole divider, the next increment is a full period away */
+    bus_write(&gg->bus, DIV, 0x12);
+    assert(bus_read(&gg->bus, DIV) == 0);
+    advance(gg, CLOCKS_PER_DIV - 1);
+    assert(bus_read(&gg->bus, DIV) == 0);
+    advance(gg, 1);
+    assert(bus_read(&gg->bus, DIV) == 1);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+void test_tima() {
+    static const uintptr_t PERIODS[] = {256, 4, 16, 64};
+    gamegirl *gg = setup();
+    uint8_t clock;
+
+    for (clock = 0; clock < 4; clock++) {
+        bus_write(&gg->bus, DIV, 0);
+        bus_write(&gg->bus, TIMA, 0);
+        bus_write(&gg->bus, TAC, TAC_ENABLE | clock);
+        advance(gg, PERIODS[clock] * 10 + PERIODS[clock] - 1);
+        assert(bus_read(&gg->bus, TIMA) == 10);
+        advance(gg, 1);
+        assert(bus_read(&gg->bus, TIMA) == 11);
+    }
+
+    /* Stopped while disabled */
+    bus_write(&gg->bus, TAC, 0x01);
+    advance(gg, 0x1000);
+    assert(bus_read(&gg->bus, TIMA) == 11);
+
+    /* Resetting the divider while the bit TIMA counts on is set counts once */
+    bus_write(&gg->bus, DIV, 0);
+    bus_write(&gg->bus, TAC, TAC_ENABLE | 0x01);
+    advance(gg, 2);
+    bus_write(&gg->bus, DIV, 0);
+    assert(bus_read(&gg->bus, TIMA) == 12);
+
+    /* So does disabling the timer with the bit set */
+    advance(gg, 2);
+    bus_write(&gg->bus, TAC, 0x01);
+    assert(bus_read(&gg->bus, TIMA) == 13);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* Overflows reload TMA and request an interrupt, at the time the scheduled event says */
+void test_overflow() {
+    gamegirl *gg = setup();
+    uintptr_t start = gg->cpu.clocks;
+
+    bus_write(&gg->bus, DIV, 0);
+    bus_write(&gg->bus, TMA, 0xF0);
+    bus_write(&gg->bus, TIMA, 0xFE);
+    bus_write(&gg->bus, TAC, TAC_ENABLE | 0x01);
+    assert(gg->sched.heap[gg->sched.index[sched_timer_e]].when == start + 8);
+    advance(gg, 7);
+    assert(bus_read(&gg->bus, TIMA) == 0xFF);
+    assert(!(bus_read(&gg->bus, IF) & INT_TIMER));
+    advance(gg, 1);
+    bus_timer_overflow(&gg->bus);
+    assert(bus_read(&gg->bus, TIMA) == 0xF0);
+    assert(bus_read(&gg->bus, IF) & INT_TIMER);
+
+    /* Every further overflow takes 0x10 increments */
+    assert(gg->sched.heap[gg->sched.index[sched_timer_e]].when == gg->cpu.clocks + 0x10 * 4);
+    advance(gg, 0x10 * 4 * 3 + 4);
+    assert(bus_read(&gg->bus, TIMA) == 0xF1);
+
+    /* Writes move the overflow */
+    bus_write(&gg->bus, TIMA, 0x80);
+    assert(gg->sched.heap[gg->sched.index[sched_timer_e]].when == gg->cpu.clocks + 0x80 * 4);
+    bus_write(&gg->bus, TAC, 0);
+    assert(gg->sched.index[sched_timer_e] == SCHED_EVENT_COUNT);
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+/* A halted CPU wakes up for every timer interrupt */
+void test_interrupt() {
+    gamegirl *gg = setup();
+    uint16_t i;
+
+    memcpy(&gg->bus.cart.data[INT_VECTOR_START + 2 * INT_VECTOR_SIZE], TIMER_HANDLER,
+           sizeof(TIMER_HANDLER));
+    for (i = 0; i < sizeof(TEST_PROGRAM); i++)
+        bus_write(&gg->bus, 0xC000 + i, TEST_PROGRAM[i]);
+    gg->cpu.pc = 0xC000;
+    gg->cpu.sp = 0xDFF0;
+    bus_write(&gg->bus, 0xFFFF, INT_TIMER);
+    bus_write(&gg->bus, TAC, TAC_ENABLE | 0x00);
+
+    while (gg->ppu.frames < 10)
+        gamegirl_clock(gg);
+    /* 256 clocks per increment and 256 increments per overflow */
+    assert(gg->cpu.regs[REG_D] == gg->cpu.clocks / (256 * 256));
+
+    gamegirl_free(gg);
+    free(gg);
+}
+
+int main() {
+    test_div();
+    test_tima();
+    test_overflow();
+    test_interrupt();
+    printf("Test: test_timer passed!\n");
+    return 0;
+}